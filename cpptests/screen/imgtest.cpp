@@ -21,10 +21,15 @@ Image_ doubled(Image_ img);
 void drawImage(Image_ img, Image_ from, int x, int y);
 void drawTransparentImage(Image_ img, Image_ from, int x, int y);
 bool overlapsWith(Image_ img, Image_ other, int x, int y);
+Buffer overlapsWithList(Image_ img, RefCollection *others, Buffer positions);
+void drawImageTransformed(Image_ img, Image_ from, Buffer matrix, bool opaque);
+void fillCircle(Image_ img, int cx, int cy, int r, int c);
+void fillPolygon(Image_ img, Buffer points, int c);
 void _drawIcon(Image_ img, Buffer icon, int xy, int c);
 void _drawLine(Image_ img, int xy, int wh, int c);
 void copyFrom(Image_ img, Image_ from);
-bool drawImageCore(Image_ img, Image_ from, int x, int y, int color);
+bool drawImageCore(Image_ img, Image_ from, int x, int y, int color, int bx0 = 0, int bx1 = -1);
+void _drawTileMap(Image_ img, Buffer tiles, RefCollection *tileset, int params);
 } // namespace ImageMethods
 
 int bpp = 4;
@@ -45,6 +50,60 @@ void golden_fillRect(Image_ img, int x, int y, int w, int h, int c) {
         }
 }
 
+// the original column-by-column fillCircle()
+void golden_fillCircle(Image_ img, int cx, int cy, int r, int c) {
+    int x = r - 1;
+    int y = 0;
+    int dx = 1;
+    int dy = 1;
+    int err = dx - (r << 1);
+
+    while (x >= y) {
+        golden_fillRect(img, cx + x, cy - y, 1, 1 + (y << 1), c);
+        golden_fillRect(img, cx + y, cy - x, 1, 1 + (x << 1), c);
+        golden_fillRect(img, cx - x, cy - y, 1, 1 + (y << 1), c);
+        golden_fillRect(img, cx - y, cy - x, 1, 1 + (x << 1), c);
+        if (err <= 0) {
+            ++y;
+            err += dy;
+            dy += 2;
+        } else {
+            --x;
+            dx += 2;
+            err += dx - (r << 1);
+        }
+    }
+}
+
+// same as TileMap.draw() in game/tilemap.ts, with tiles cropped as in getTileImage()
+void golden_drawTileMap(Image_ img, Buffer tiles, RefCollection *tileset, int scale, int camX,
+                        int camY) {
+    int size = 1 << scale;
+    int mapW = tiles->data[0] | (tiles->data[1] << 8);
+    int mapH = tiles->data[2] | (tiles->data[3] << 8);
+    int offX = camX & (size - 1);
+    int offY = camY & (size - 1);
+    int x0 = max(0, camX >> scale);
+    int xn = min(mapW, ((camX + img->width()) >> scale) + 1);
+    int y0 = max(0, camY >> scale);
+    int yn = min(mapH, ((camY + img->height()) >> scale) + 1);
+    for (int x = x0; x <= xn; ++x)
+        for (int y = y0; y <= yn; ++y) {
+            int idx = x < mapW && y < mapH ? tiles->data[4 + x + y * mapW] : 0;
+            if (idx >= Array_::length(tileset))
+                continue;
+            auto tile = (Image_)Array_::getAt(tileset, idx);
+            if (tile->width() > size || tile->height() > size) {
+                auto crop = mkImage(size, size, 4);
+                ImageMethods::fill(crop, 0);
+                ImageMethods::drawImage(crop, tile, 0, 0);
+                tile = crop;
+            }
+            golden_drawTransparentImage(img, tile, ((x - x0) << scale) - offX,
+                                        ((y - y0) << scale) - offY);
+        }
+}
+
 int randCol() {
     return rand() & ((1<<bpp)-1);
 }
@@ -106,6 +165,16 @@ int rr(int min, int max) {
     return rand() % (max - min) + min;
 }
 
+// image with a random share of up to 1/4 of pixels set, so that overlaps aren't a given
+Image_ sparseImg(int w, int h) {
+    auto img = mkImage(w, h, bpp);
+    ImageMethods::fill(img, 0);
+    int n = rr(0, w * h / 4 + 2);
+    for (int i = 0; i < n; ++i)
+        ImageMethods::setPixel(img, rr(0, w), rr(0, h), rr(1, 1 << bpp));
+    return img;
+}
+
 Image_ s1, s2;
 
 void refill() {
@@ -178,11 +247,161 @@ void testBPP() {
 
 }
 
+// overlapsWith() uses cached collision masks; drawImageCore(..., -1) is the old algorithm
+void checkOverlaps(Image_ a, Image_ b, int x, int y) {
+    bool exp = ImageMethods::drawImageCore(a, b, x, y, -1);
+    if (ImageMethods::overlapsWith(a, b, x, y) != exp) {
+        printf("overlapsWith mismatch: %dx%d at %d,%d in %dx%d, expected %d\n", b->width(),
+               b->height(), x, y, a->width(), a->height(), exp);
+        abort();
+    }
+}
+
+void testOverlaps() {
+    for (int i = 0; i < 2000; ++i) {
+        auto a = sparseImg(rr(1, 70), rr(1, 70));
+        auto b = sparseImg(rr(1, 40), rr(1, 40));
+        // mostly with intersecting bounds, including negative and unaligned y
+        auto x = rr(-b->width() - 4, a->width() + 4);
+        auto y = rr(-b->height() - 4, a->height() + 4);
+        checkOverlaps(a, b, x, y);
+
+        // the masks have to follow changes to either image
+        ImageMethods::setPixel(b, rr(0, b->width()), rr(0, b->height()), rr(0, 1 << bpp));
+        checkOverlaps(a, b, x, y);
+        ImageMethods::setPixel(a, rr(0, a->width()), rr(0, a->height()), rr(0, 1 << bpp));
+        checkOverlaps(a, b, x, y);
+        ImageMethods::fill(b, 0);
+        checkOverlaps(a, b, x, y);
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        auto a = sparseImg(rr(1, 70), rr(1, 70));
+        auto others = Array_::mk();
+        int num = rr(1, 10);
+        auto positions = mkBuffer(NULL, num * 4);
+        auto pos = (int16_t *)positions->data;
+        for (int j = 0; j < num; ++j) {
+            Array_::push(others, (TValue)sparseImg(rr(1, 40), rr(1, 40)));
+            pos[2 * j] = rr(-45, 75);
+            pos[2 * j + 1] = rr(-45, 75);
+        }
+        auto res = ImageMethods::overlapsWithList(a, others, positions);
+        for (int j = 0; j < num; ++j) {
+            auto b = (Image_)Array_::getAt(others, j);
+            if (res->data[j] != ImageMethods::drawImageCore(a, b, pos[2 * j], pos[2 * j + 1], -1)) {
+                printf("overlapsWithList mismatch at %d\n", j);
+                abort();
+            }
+        }
+    }
+
+    printf("OK overlaps bpp=%d\n", bpp);
+}
+
+// a translation has to give exactly the same pixels as the plain blits
+void testTransformed() {
+    for (int i = 0; i < 500; ++i) {
+        auto x = rr(-30, 200);
+        auto y = rr(-30, 200);
+        auto sprite = randomImg(rr(1, 40), rr(1, 40));
+        int32_t m[6] = {0x10000, 0, x * 0x10000, 0, 0x10000, y * 0x10000};
+        auto matrix = mkBuffer(m, sizeof(m));
+
+        refill();
+        ImageMethods::drawImageTransformed(s1, sprite, matrix, false);
+        golden_drawTransparentImage(s2, sprite, x, y);
+        assertSame(s1, s2);
+
+        refill();
+        ImageMethods::drawImageTransformed(s1, sprite, matrix, true);
+        golden_drawTransparentImage(s2, sprite, x, y, -2);
+        assertSame(s1, s2);
+    }
+
+    printf("OK transformed bpp=%d\n", bpp);
+}
+
+void testShapes() {
+    for (int i = 0; i < 500; ++i) {
+        auto x = rr(-30, 200);
+        auto y = rr(-30, 200);
+        auto w = rr(0, 60);
+        auto h = rr(0, 60);
+        auto col = randCol();
+
+        // the corners of the rectangle, from a random vertex in either direction
+        int16_t corners[8] = {(int16_t)x,       (int16_t)y,       (int16_t)(x + w), (int16_t)y,
+                              (int16_t)(x + w), (int16_t)(y + h), (int16_t)x,       (int16_t)(y + h)};
+        int16_t pts[8];
+        int start = rr(0, 4);
+        int dir = rr(0, 2) ? 1 : 3;
+        for (int k = 0; k < 4; ++k) {
+            int v = (start + k * dir) & 3;
+            pts[2 * k] = corners[2 * v];
+            pts[2 * k + 1] = corners[2 * v + 1];
+        }
+
+        refill();
+        ImageMethods::fillPolygon(s1, mkBuffer(pts, sizeof(pts)), col);
+        golden_fillRect(s2, x, y, w, h, col);
+        assertSame(s1, s2);
+
+        auto r = rr(0, 50);
+        refill();
+        ImageMethods::fillCircle(s1, x, y, r, col);
+        golden_fillCircle(s2, x, y, r, col);
+        assertSame(s1, s2);
+    }
+
+    printf("OK shapes bpp=%d\n", bpp);
+}
+
+void testTileMap() {
+    for (int i = 0; i < 200; ++i) {
+        int scale = rr(2, 6);
+        int size = 1 << scale;
+        auto tileset = Array_::mk();
+        int numTiles = rr(1, 6);
+        for (int j = 0; j < numTiles; ++j) {
+            // some tiles are larger than the cell, some have no transparent pixels
+            auto tile = randomImg(rr(size / 2, size * 2), rr(size / 2, size * 2));
+            if (rand() & 1)
+                ImageMethods::replace(tile, 0, 1);
+            Array_::push(tileset, (TValue)tile);
+        }
+        int mapW = rr(1, 20);
+        int mapH = rr(1, 20);
+        auto tiles = mkBuffer(NULL, 4 + mapW * mapH);
+        tiles->data[0] = mapW;
+        tiles->data[2] = mapH;
+        for (int j = 0; j < mapW * mapH; ++j)
+            tiles->data[4 + j] = rr(0, numTiles + 2);
+        int camX = rr(-60, 300);
+        int camY = rr(-60, 300);
+
+        refill();
+        ImageMethods::_drawTileMap(s1, tiles, tileset,
+                                   scale | ((camX & 0x3fff) << 3) | (camY * (1 << 17)));
+        golden_drawTileMap(s2, tiles, tileset, scale, camX, camY);
+        assertSame(s1, s2);
+    }
+
+    printf("OK tilemap\n");
+}
+
 extern "C" int main() {
     bpp = 1;    
     testBPP();
+    testOverlaps();
+    testTransformed();
+    testShapes();
     bpp = 4;    
     testBPP();
+    testOverlaps();
+    testTransformed();
+    testShapes();
+    testTileMap();
     return 0;
 }
 
@@ -182,7 +182,7 @@ static int utf8canon(char *dst, const char *data, int size) {
     return outsz;
 }
 
-static int utf8CharCode(const char *data) {
+int utf8CharCode(const char *data) {
     unsigned char c = *data;
     if ((c & 0x80) == 0) {
         return c;
@@ -448,7 +448,7 @@ String charAt(String s, int pos) {
     return fromCharCode(numValue(v));
 }
 
-#define IS_CONS(s) ((s)->vtable == &string_cons_vt)
+#define IS_CONS(s) (getVTable(s) == &string_cons_vt)
 #define IS_EMPTY(s) ((s) == (String)emptyString)
 
 //%
@@ -1536,6 +1536,7 @@ TValue ldlocRef(RefRefLocal *r) {
 //%
 void stlocRef(RefRefLocal *r, TValue v) {
     r->v = v;
+    gcWriteBarrier(r, v);
 }
 
 //%
@@ -1638,6 +1639,7 @@ void mapSetByString(RefMap *map, String key, TValue val) {
     if (i < 0) {
         map->keys.push((TValue)key);
         map->values.push(val);
+        map->addToIndex(map->keys.getLength() - 1);
     } else {
         map->values.set(i, val);
     }
@@ -1809,10 +1811,10 @@ extern LLSegment workQueue;
 static uint32_t fixSize(BoxedString *p, uint32_t *len) {
     uint32_t tlen = 0;
     uint32_t sz = 0;
-    if (workQueue.getLength())
-        oops(81);
+    // with incremental GC the queue may hold gray objects; leave them alone
+    auto base = workQueue.getLength();
     workQueue.push((TValue)p);
-    while (workQueue.getLength()) {
+    while (workQueue.getLength() > base) {
         p = (BoxedString *)workQueue.pop();
         if (IS_CONS(p)) {
             workQueue.push((TValue)p->cons.right);
@@ -1827,11 +1829,9 @@ static uint32_t fixSize(BoxedString *p, uint32_t *len) {
 }
 
 static void fixCopy(BoxedString *p, char *dst) {
-    if (workQueue.getLength())
-        oops(81);
-
+    auto base = workQueue.getLength();
     workQueue.push((TValue)p);
-    while (workQueue.getLength()) {
+    while (workQueue.getLength() > base) {
         p = (BoxedString *)workQueue.pop();
         if (IS_CONS(p)) {
             workQueue.push((TValue)p->cons.right);
@@ -1856,10 +1856,12 @@ static void fixCons(BoxedString *r) {
     // copy, while [r] is still cons
     fixCopy(r, (char *)(data + numSkips));
     // now, set [r] up properly
-    r->vtable = &string_skiplist16_vt;
+    // keep the mark bit, in case [r] is yet to be lazily swept
+    r->setVT((uintptr_t)&string_skiplist16_vt | (r->vt() & 1));
     r->skip.size = sz;
     r->skip.length = length;
     r->skip.list = data;
+    gcAttachArray(r, data);
     setupSkipList(r, NULL, 0);
 }
 #endif
@@ -48,6 +48,56 @@
 
 //#define PXT_GC_CHECKS 1
 
+// Generational mode: small objects are bump-allocated in a nursery carved out of the free list,
+// and collected by minor GCs that only trace the nursery, starting from roots and the
+// remembered set. Only enable it when all pointer stores into heap objects go through
+// gcWriteBarrier*() - this is the case for the VM, but not for natively compiled code.
+//#define PXT_GC_NURSERY 1
+
+#if defined(PXT_GC_NURSERY) && !defined(PXT_VM)
+#error "PXT_GC_NURSERY requires PXT_VM"
+#endif
+
+// free blocks of GC_MIN_CLASS_WORDS..GC_MAX_CLASS_WORDS words are kept in per-size lists
+// instead of the address-ordered firstFree list
+#define GC_MIN_CLASS_WORDS 2
+#ifndef GC_MAX_CLASS_WORDS
+#define GC_MAX_CLASS_WORDS 16
+#endif
+#define GC_NUM_CLASSES (GC_MAX_CLASS_WORDS - GC_MIN_CLASS_WORDS + 1)
+
+// Lazy sweep mode: gc() only marks; the heap is then swept GC_SWEEP_BUDGET words at a time
+// from gcAllocate(). Live objects keep their mark bit until swept, so all code has to use
+// getVTable() and not look at RefObject::vtable directly. Natively compiled code loads the
+// vtable word itself, so this is only available in the VM.
+//#define PXT_GC_LAZY_SWEEP 1
+
+#if defined(PXT_GC_LAZY_SWEEP) && !defined(PXT_VM)
+#error "PXT_GC_LAZY_SWEEP requires PXT_VM"
+#endif
+
+#ifndef GC_SWEEP_BUDGET
+#define GC_SWEEP_BUDGET 1024
+#endif
+
+// Incremental mode: once half of the free memory is used, roots are grayed and marking
+// continues in gcIncrementalStep() calls from the scheduler, with the write barrier graying
+// stored values. The final gc() rescans the roots and sweeps. The same restrictions as
+// for PXT_GC_NURSERY apply.
+//#define PXT_GC_INCREMENTAL 1
+
+#if defined(PXT_GC_INCREMENTAL) && !defined(PXT_VM)
+#error "PXT_GC_INCREMENTAL requires PXT_VM"
+#endif
+
+#if defined(PXT_GC_INCREMENTAL) && defined(PXT_GC_NURSERY)
+#error "PXT_GC_INCREMENTAL and PXT_GC_NURSERY cannot be used together"
+#endif
+
+#ifndef GC_NURSERY_SIZE
+#define GC_NURSERY_SIZE (GC_BLOCK_SIZE / 2)
+#endif
+
 #define MARK(v)                                                                                    \
     do {                                                                                           \
         GC_CHECK(inGCArea(v), 42);                                                                 \
@@ -74,7 +124,7 @@
 
 namespace pxt {
 
-// keep in sync with base/control.ts, function gcStats()
+// keep in sync with base/gcstats.ts, function gcStats()
 struct GCStats {
     uint32_t numGC;
     uint32_t numBlocks;
@@ -82,15 +132,157 @@ struct GCStats {
     uint32_t lastFreeBytes;
     uint32_t lastMaxBlockBytes;
     uint32_t minFreeBytes;
+    uint32_t numMinorGC;
+    uint32_t lastPromotedBytes;
+    // allocations served from the size-class lists, for minClassWords ... maxClassWords words
+    uint32_t minClassWords;
+    uint32_t maxClassWords;
+    uint32_t sizeClassHits[GC_NUM_CLASSES];
+    // longest time spent in a single collection or sweep step
+    uint32_t maxPauseUs;
 };
 
 static GCStats gcStats;
 
 //% expose
 Buffer getGCStats() {
+    gcStats.minClassWords = GC_MIN_CLASS_WORDS;
+    gcStats.maxClassWords = GC_MAX_CLASS_WORDS;
     return mkBuffer((uint8_t *)&gcStats, sizeof(gcStats));
 }
 
+// Heap census: live objects per VTable, collected by sweep() on request
+#ifndef GC_CENSUS_SIZE
+#define GC_CENSUS_SIZE 64
+#endif
+#define CENSUS_ARRAY ((const VTable *)1)
+#define CENSUS_OTHER ((const VTable *)2)
+
+struct GCCensusEntry {
+    const VTable *vtable;
+    uint32_t numObjects;
+    uint32_t numBytes;
+};
+static GCCensusEntry *census;
+static uint32_t censusUsed;
+
+static void censusAddCore(const VTable *key, uint32_t words) {
+    auto h = (uint32_t)(((uintptr_t)key >> 2) * 2654435761U) & (GC_CENSUS_SIZE - 1);
+    while (census[h].vtable && census[h].vtable != key)
+        h = (h + 1) & (GC_CENSUS_SIZE - 1);
+    auto e = &census[h];
+    if (!e->vtable) {
+        // keep the table at most 3/4 full, and lump the rest together
+        if (censusUsed * 4 >= GC_CENSUS_SIZE * 3 && key != CENSUS_OTHER) {
+            censusAddCore(CENSUS_OTHER, words);
+            return;
+        }
+        e->vtable = key;
+        censusUsed++;
+    }
+    e->numObjects++;
+    e->numBytes += WORDS_TO_BYTES(words);
+}
+
+static void censusAdd(RefObject *o, uint32_t words) {
+    auto vt = o->vt() & ~ANY_MARKED_MASK;
+    censusAddCore(IS_VAR_BLOCK(vt) ? CENSUS_ARRAY : (const VTable *)vt, words);
+}
+
+/**
+ * Run full GC, and return live objects per type, as triples of uint32_t:
+ * class number (0 for arrays, 0xffff for types that didn't fit), number of objects and bytes.
+ */
+//% expose
+Buffer getGCCensus() {
+    census = (GCCensusEntry *)xmalloc(GC_CENSUS_SIZE * sizeof(GCCensusEntry));
+    memset(census, 0, GC_CENSUS_SIZE * sizeof(GCCensusEntry));
+    censusUsed = 0;
+    gc(4); // non-zero flags make sure sweep is not deferred
+
+    uint32_t tmp[GC_CENSUS_SIZE * 3];
+    uint32_t n = 0;
+    for (unsigned i = 0; i < GC_CENSUS_SIZE; ++i) {
+        auto e = &census[i];
+        if (!e->vtable)
+            continue;
+        tmp[n++] = e->vtable == CENSUS_ARRAY   ? 0
+                   : e->vtable == CENSUS_OTHER ? 0xffff
+                                               : (uint32_t)e->vtable->classNo;
+        tmp[n++] = e->numObjects;
+        tmp[n++] = e->numBytes;
+    }
+    xfree(census);
+    census = NULL;
+    return mkBuffer((uint8_t *)tmp, n * sizeof(uint32_t));
+}
+
+// Allocation sampling: every n-th allocation records its size and where it came from
+#ifndef GC_NUM_SAMPLES
+#define GC_NUM_SAMPLES 64
+#endif
+
+#if !defined(PXT_VM) && defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+struct GCAllocSample {
+    gcsample_t numBytes;
+    gcsample_t stack[GC_SAMPLE_DEPTH];
+};
+static GCAllocSample *allocSamples;
+static uint32_t sampleInterval, sampleCountdown, numAllocSamples;
+
+__attribute__((noinline)) static void sampleAllocation(int numbytes, void *caller) {
+    sampleCountdown = sampleInterval;
+    auto s = &allocSamples[numAllocSamples++ % GC_NUM_SAMPLES];
+    memset(s, 0, sizeof(*s));
+    s->numBytes = numbytes;
+#if defined(PXT_VM)
+    (void)caller;
+    vmCaptureStack(s->stack, GC_SAMPLE_DEPTH);
+#elif defined(__GLIBC__)
+    (void)caller;
+    void *frames[GC_SAMPLE_DEPTH + 2];
+    // skip sampleAllocation() and gcAllocate()
+    int n = backtrace(frames, GC_SAMPLE_DEPTH + 2);
+    for (int i = 2; i < n; ++i)
+        s->stack[i - 2] = (gcsample_t)frames[i];
+#else
+    // no unwinder on devices; only the caller of gcAllocate() is recorded
+    s->stack[0] = (gcsample_t)caller;
+#endif
+}
+
+/**
+ * Record every n-th allocation; 0 disables sampling.
+ */
+//% expose
+void setGCAllocSampling(int interval) {
+    if (interval > 0 && !allocSamples)
+        allocSamples = (GCAllocSample *)xmalloc(GC_NUM_SAMPLES * sizeof(GCAllocSample));
+    sampleInterval = sampleCountdown = interval > 0 ? interval : 0;
+    numAllocSamples = 0;
+}
+
+/**
+ * Return recently sampled allocations, oldest first; each is the size in bytes followed by
+ * GC_SAMPLE_DEPTH (4) code locations, innermost first, zero-filled when the stack is shallower.
+ * In the VM these are UInt32LE word offsets in the image. Native builds store pointer-sized
+ * return addresses (UInt64LE on 64-bit hosts), and only the first one on devices.
+ */
+//% expose
+Buffer getGCAllocSamples() {
+    auto total = numAllocSamples;
+    auto num = min(total, (uint32_t)GC_NUM_SAMPLES);
+    auto r = mkBuffer(NULL, num * sizeof(GCAllocSample));
+    for (unsigned i = 0; i < num; ++i) {
+        auto idx = (total - num + i) % GC_NUM_SAMPLES;
+        memcpy(r->data + i * sizeof(GCAllocSample), &allocSamples[idx], sizeof(GCAllocSample));
+    }
+    return r;
+}
+
 //%
 void popThreadContext(ThreadContext *ctx);
 //%
@@ -109,6 +301,8 @@ ThreadContext *threadContexts;
 #define IN_GC_COLLECT 2
 #define IN_GC_FREEZE 4
 #define IN_GC_PREALLOC 8
+#define IN_GC_MINOR 16
+#define IN_GC_SHADE 32
 
 #ifndef PXT_VM
 static TValue *tempRoot;
@@ -230,8 +424,34 @@ static LLSegment gcRoots;
 LLSegment workQueue; // (ab)used by consString making
 static GCBlock *firstBlock;
 static RefBlock *firstFree;
+static RefBlock *classFree[GC_NUM_CLASSES];
 static uint8_t *midPtr;
 
+#ifdef PXT_GC_INCREMENTAL
+// set from startIncrementalMark() until the end of the next gc()
+static bool incMarking;
+#endif
+
+#ifdef PXT_GC_NURSERY
+// nurseryStart..nurseryPtr is allocated, nurseryPtr..nurseryEnd is free
+static uint8_t *nurseryStart, *nurseryPtr, *nurseryEnd;
+// set when there was no free block big enough for a nursery; cleared by major GC
+static bool nurseryBlocked;
+
+// open-addressing set of old objects and arrays that may point into the nursery
+static uintptr_t *remembered;
+static uint32_t rememberedMask, numRemembered;
+// a TValue array (the pointer is to its header)
+#define REM_ARRAY 1
+// object allocated outside the nursery while it was active
+#define REM_NEW 2
+
+#define IN_NURSERY(p) ((uint8_t *)(p) >= nurseryStart && (uint8_t *)(p) < nurseryPtr)
+#define SKIP_OLD(p) ((inGC & IN_GC_MINOR) && !IN_NURSERY(p))
+#else
+#define SKIP_OLD(p) 0
+#endif
+
 static bool inGCArea(void *ptr) {
     for (auto block = firstBlock; block; block = block->next) {
         if ((void *)block->data <= ptr && ptr < (void *)((uint8_t *)block->data + block->blockSize))
@@ -243,10 +463,23 @@ static bool inGCArea(void *ptr) {
 #define NO_MAGIC(vt) ((VTable *)vt)->magic != VTABLE_MAGIC
 #define VT(p) (*(uintptr_t *)(p))
 #define SKIP_PROCESSING(p)                                                                         \
-    (isReadOnly(p) || (VT(p) & (ANY_MARKED_MASK | ARRAY_MASK)) || NO_MAGIC(VT(p)))
+    (isReadOnly(p) || SKIP_OLD(p) || (VT(p) & (ANY_MARKED_MASK | ARRAY_MASK)) ||                  \
+     NO_MAGIC(VT(p)))
 
 void gcMarkArray(void *data) {
     auto segBl = (uintptr_t *)data - 1;
+#ifdef PXT_GC_NURSERY
+    if (inGC & IN_GC_MINOR) {
+        // remembered arrays can be reached twice
+        if (SKIP_OLD(segBl) || IS_MARKED(VT(segBl)))
+            return;
+    }
+#endif
+#ifdef PXT_GC_INCREMENTAL
+    // arrays may get marked by the write barrier before their owner is scanned
+    if (incMarking && IS_MARKED(VT(segBl)))
+        return;
+#endif
     GC_CHECK(!IS_MARKED(VT(segBl)), 47);
     MARK(segBl);
 }
@@ -292,19 +525,12 @@ void gcScanSegment(Segment &seg) {
 #define getScanMethod(vt) ((RefObjectMethod)(((VTable *)(vt))->methods[2]))
 #define getSizeMethod(vt) ((RefObjectSizeMethod)(((VTable *)(vt))->methods[3]))
 
-void gcProcess(TValue v) {
-    if (SKIP_PROCESSING(v))
-        return;
-    VVLOG("gcProcess: %p", v);
-    MARK(v);
-    auto scan = getScanMethod(VT(v) & ~ANY_MARKED_MASK);
-    if (scan)
-        scan((RefObject *)v);
+static void processQueue() {
     for (;;) {
         while (workQueue.getLength()) {
             auto curr = (RefObject *)workQueue.pop();
             VVLOG(" - %p", curr);
-            scan = getScanMethod(curr->vt() & ~ANY_MARKED_MASK);
+            auto scan = getScanMethod(curr->vt() & ~ANY_MARKED_MASK);
             if (scan)
                 scan(curr);
         }
@@ -321,6 +547,24 @@ void gcProcess(TValue v) {
     }
 }
 
+void gcProcess(TValue v) {
+    if (SKIP_PROCESSING(v))
+        return;
+    VVLOG("gcProcess: %p", v);
+    MARK(v);
+#ifdef PXT_GC_INCREMENTAL
+    // starting incremental marking; only gray the roots
+    if (inGC & IN_GC_SHADE) {
+        workQueue.push(v);
+        return;
+    }
+#endif
+    auto scan = getScanMethod(VT(v) & ~ANY_MARKED_MASK);
+    if (scan)
+        scan((RefObject *)v);
+    processQueue();
+}
+
 static void mark(int flags) {
 #ifdef PXT_GC_DEBUG
     flags |= 2;
@@ -484,67 +728,93 @@ __attribute__((noinline)) static void allocateBlock() {
     linkFreeBlock(curr);
 }
 
-static void sweep(int flags) {
-    RefBlock *prevFreePtr = NULL;
-    uint32_t freeSize = 0;
-    uint32_t totalSize = 0;
-    uint32_t maxFreeBlock = 0;
+// destroys dead objects from start on, and turns them, together with any free blocks
+// in between, into a single free block; returns its size in words
+static uint32_t sweepDeadRun(RefObject *start, RefObject *end) {
+    auto d = start;
+    while (d < end) {
+        if (IS_FREE(d->vtable)) {
+            VVLOG("Free %p", d);
+        } else if (IS_LIVE(d->vtable)) {
+            break;
+        } else if (IS_ARRAY(d->vtable)) {
+            VVLOG("Dead Arr %p", d);
+        } else {
+            VVLOG("Dead Obj %p", d);
+            GC_CHECK(d->vtable->magic == VTABLE_MAGIC, 41);
+            d->destroyVT();
+            VVLOG("destroyed");
+        }
+        d += getObjectSize(d);
+    }
+    uint32_t sz = d - start;
+#ifdef PXT_GC_CHECKS
+    memset((void *)start, 0xff, WORDS_TO_BYTES(sz));
+#endif
+    start->setVT((sz << 2) | FREE_MASK);
+    return sz;
+}
+
+static bool addClassFree(RefBlock *b, uint32_t sz) {
+    if (sz < GC_MIN_CLASS_WORDS || sz > GC_MAX_CLASS_WORDS)
+        return false;
+    b->nextFree = classFree[sz - GC_MIN_CLASS_WORDS];
+    classFree[sz - GC_MIN_CLASS_WORDS] = b;
+    return true;
+}
+
+// take a block of numwords from the smallest non-empty size class that fits; any remainder
+// goes back to its own class (or is left as a one-word hole for the next sweep)
+static RefBlock *allocClassFree(uint32_t numwords) {
+    for (auto sz = numwords; sz <= GC_MAX_CLASS_WORDS; ++sz) {
+        auto p = classFree[sz - GC_MIN_CLASS_WORDS];
+        if (!p)
+            continue;
+        GC_CHECK(IS_FREE(p->vtable) && VAR_BLOCK_WORDS(p->vtable) == sz, 43);
+        classFree[sz - GC_MIN_CLASS_WORDS] = p->nextFree;
+        auto left = sz - numwords;
+        if (left) {
+            auto rest = (RefBlock *)((void **)p + numwords);
+            rest->setVT((left << 2) | FREE_MASK);
+            addClassFree(rest, left);
+        }
+        gcStats.sizeClassHits[numwords - GC_MIN_CLASS_WORDS]++;
+        return p;
+    }
+    return NULL;
+}
+
+// sweep state, kept between calls to sweepStep(); sweepBlock is NULL when no sweep is pending
+static GCBlock *sweepBlock;
+static RefObject *sweepPtr;
+static RefBlock *sweepTail; // last block on firstFree list
+static uint32_t sweepFreeSize, sweepTotalSize, sweepMaxFree, sweepListSize;
+static int sweepFlags;
+
+static void startSweep(int flags) {
     firstFree = NULL;
+    memset(classFree, 0, sizeof(classFree));
+    sweepTail = NULL;
+    sweepFreeSize = sweepTotalSize = sweepMaxFree = sweepListSize = 0;
+    sweepFlags = flags;
+    sweepBlock = firstBlock;
+    sweepPtr = firstBlock ? firstBlock->data : NULL;
 
     gcStats.numGC++;
+}
 
-    for (auto h = firstBlock; h; h = h->next) {
-        auto d = h->data;
-        auto words = BYTES_TO_WORDS(h->blockSize);
-        auto end = d + words;
-        totalSize += words;
-        VLOG("sweep: %p - %p", d, end);
-        while (d < end) {
-            if (IS_LIVE(d->vtable)) {
-                VVLOG("Live %p", d);
-                d->setVT(d->vt() & ~MARKED_MASK);
-                d += getObjectSize(d);
-            } else {
-                auto start = (RefBlock *)d;
-                while (d < end) {
-                    if (IS_FREE(d->vtable)) {
-                        VVLOG("Free %p", d);
-                    } else if (IS_LIVE(d->vtable)) {
-                        break;
-                    } else if (IS_ARRAY(d->vtable)) {
-                        VVLOG("Dead Arr %p", d);
-                    } else {
-                        VVLOG("Dead Obj %p", d);
-                        GC_CHECK(d->vtable->magic == VTABLE_MAGIC, 41);
-                        d->destroyVT();
-                        VVLOG("destroyed");
-                    }
-                    d += getObjectSize(d);
-                }
-                auto sz = d - (RefObject *)start;
-                freeSize += sz;
-                if (sz > (int)maxFreeBlock)
-                    maxFreeBlock = sz;
-#ifdef PXT_GC_CHECKS
-                memset((void *)start, 0xff, WORDS_TO_BYTES(sz));
+static void finishSweep() {
+    uint32_t freeSize = sweepFreeSize;
+#ifdef PXT_GC_NURSERY
+    // there might be space for a new nursery now
+    nurseryBlocked = false;
 #endif
-                start->setVT((sz << 2) | FREE_MASK);
-                if (sz > 1) {
-                    start->nextFree = NULL;
-                    if (!prevFreePtr) {
-                        firstFree = start;
-                    } else {
-                        prevFreePtr->nextFree = start;
-                    }
-                    prevFreePtr = start;
-                }
-            }
-        }
-    }
+    uint32_t totalSize = sweepTotalSize;
+    uint32_t maxFreeBlock = sweepMaxFree;
 
     if (midPtr) {
         uint32_t currFree = 0;
-        auto limit = freeSize * 1 / 2;
+        auto limit = sweepListSize * 1 / 2;
         for (auto p = firstFree; p; p = p->nextFree) {
             auto len = VAR_BLOCK_WORDS(p->vtable);
             currFree += len;
@@ -565,7 +835,7 @@ static void sweep(int flags) {
     if (gcStats.minFreeBytes == 0 || gcStats.minFreeBytes > freeSize)
         gcStats.minFreeBytes = freeSize;
 
-    if (flags & 1)
+    if (sweepFlags & 1)
         DMESG("GC %d/%d free; %d maxBlock", freeSize, totalSize, maxFreeBlock);
     else
         LOG("GC %d/%d free; %d maxBlock", freeSize, totalSize, maxFreeBlock);
@@ -578,15 +848,385 @@ static void sweep(int flags) {
 #endif
 }
 
+// sweeps about budget words of the heap; finishes the sweep when it gets to the end
+static void sweepStep(uint32_t budget) {
+    while (sweepBlock) {
+        auto h = sweepBlock;
+        auto d = sweepPtr;
+        auto end = h->data + BYTES_TO_WORDS(h->blockSize);
+        if (d == h->data) {
+            sweepTotalSize += end - d;
+            VLOG("sweep: %p - %p", d, end);
+        }
+        while (d < end && budget) {
+            auto curr = d;
+            if (IS_LIVE(d->vtable)) {
+                VVLOG("Live %p", d);
+                auto sz = getObjectSize(d);
+                if (census)
+                    censusAdd(d, sz);
+                d->setVT(d->vt() & ~MARKED_MASK);
+                d += sz;
+            } else {
+                auto start = (RefBlock *)d;
+                auto sz = sweepDeadRun(d, budget < (uint32_t)(end - d) ? d + budget : end);
+                d += sz;
+                sweepFreeSize += sz;
+                if (sz > sweepMaxFree)
+                    sweepMaxFree = sz;
+                if (sz > 1 && !addClassFree(start, sz)) {
+                    sweepListSize += sz;
+                    start->nextFree = NULL;
+                    if (!sweepTail) {
+                        firstFree = start;
+                    } else {
+                        sweepTail->nextFree = start;
+                    }
+                    sweepTail = start;
+                }
+            }
+            uint32_t done = d - curr;
+            budget = done < budget ? budget - done : 0;
+        }
+        if (d < end) {
+            sweepPtr = d;
+            return;
+        }
+        sweepBlock = h->next;
+        sweepPtr = sweepBlock ? sweepBlock->data : NULL;
+    }
+    finishSweep();
+}
+
+static void sweep(int flags) {
+    startSweep(flags);
+    sweepStep(0xffffffff);
+}
+
+static void notePause(uint64_t start) {
+    auto len = (uint32_t)(current_time_us() - start);
+    if (len > gcStats.maxPauseUs)
+        gcStats.maxPauseUs = len;
+}
+
+#ifdef PXT_GC_NURSERY
+static void remember(uintptr_t v) {
+    if ((numRemembered + 1) * 2 > rememberedMask + 1) {
+        auto oldMask = rememberedMask;
+        auto old = remembered;
+        rememberedMask = old ? 2 * oldMask + 1 : 63;
+        remembered = (uintptr_t *)xmalloc((rememberedMask + 1) * sizeof(uintptr_t));
+        memset(remembered, 0, (rememberedMask + 1) * sizeof(uintptr_t));
+        numRemembered = 0;
+        if (old) {
+            for (unsigned i = 0; i <= oldMask; ++i)
+                if (old[i])
+                    remember(old[i]);
+            xfree(old);
+        }
+    }
+    auto h = (uint32_t)((v >> 2) * 2654435761U) & rememberedMask;
+    while (remembered[h]) {
+        if (remembered[h] == v)
+            return;
+        h = (h + 1) & rememberedMask;
+    }
+    remembered[h] = v;
+    numRemembered++;
+}
+
+static void scanRemembered() {
+    for (unsigned i = 0; i <= rememberedMask && numRemembered; ++i) {
+        auto e = remembered[i];
+        if (!e)
+            continue;
+        auto p = (RefObject *)(e & ~(REM_ARRAY | REM_NEW));
+        auto vt = p->vt() & ~ANY_MARKED_MASK;
+        if (!vt || IS_FREE(vt))
+            continue;
+        if (IS_ARRAY(vt)) {
+            // only arrays coming from Segment are known to hold TValues
+            if (!(e & REM_ARRAY) || IS_PERMA(vt))
+                continue;
+            if (IN_NURSERY(p) && !IS_MARKED(p->vt()))
+                MARK(p);
+            gcScanMany((TValue *)p + 1, VAR_BLOCK_WORDS(vt) - 1);
+        } else {
+            auto scan = getScanMethod(vt);
+            if (scan)
+                scan(p);
+        }
+        processQueue();
+    }
+}
+
+static void clearRemembered() {
+    if (numRemembered) {
+        memset(remembered, 0, (rememberedMask + 1) * sizeof(uintptr_t));
+        numRemembered = 0;
+    }
+}
+
+// make the unused part of the nursery walkable by sweep
+static void sealNursery() {
+    if (nurseryPtr < nurseryEnd)
+        ((RefObject *)nurseryPtr)->setVT((BYTES_TO_WORDS(nurseryEnd - nurseryPtr) << 2) | FREE_MASK);
+}
+
+static void retireNursery() {
+    nurseryStart = nurseryPtr = nurseryEnd = NULL;
+    clearRemembered();
+}
+
+static bool carveNursery() {
+    if (nurseryBlocked)
+        return false;
+
+    uint32_t want = BYTES_TO_WORDS(GC_NURSERY_SIZE);
+    RefBlock *prev = NULL;
+    for (auto p = firstFree; p; p = p->nextFree) {
+        uint32_t len = VAR_BLOCK_WORDS(p->vtable);
+        if (len >= want) {
+            auto next = p->nextFree;
+            if (len - want >= 2) {
+                auto nf = (RefBlock *)((void **)p + want);
+                nf->setVT(((len - want) << 2) | FREE_MASK);
+                nf->nextFree = next;
+                next = nf;
+            } else {
+                want = len;
+            }
+            if (prev)
+                prev->nextFree = next;
+            else
+                firstFree = next;
+            if (p == sweepTail)
+                sweepTail = next ? next : prev;
+            nurseryStart = nurseryPtr = (uint8_t *)p;
+            nurseryEnd = nurseryStart + WORDS_TO_BYTES(want);
+            VLOG("nursery: %p - %p", nurseryStart, nurseryEnd);
+            return true;
+        }
+        prev = p;
+    }
+
+    nurseryBlocked = true;
+    return false;
+}
+
+static void sweepNursery() {
+    auto d = (RefObject *)nurseryStart;
+    auto end = (RefObject *)nurseryEnd;
+
+    // the free list is sorted by address; find where the nursery goes
+    RefBlock *prevFree = NULL;
+    for (auto p = firstFree; p && (RefObject *)p < d; p = p->nextFree)
+        prevFree = p;
+    auto nextFree = prevFree ? prevFree->nextFree : firstFree;
+
+    uint32_t liveSize = 0;
+    while (d < end) {
+        if (IS_LIVE(d->vtable)) {
+            d->setVT(d->vt() & ~MARKED_MASK);
+            auto sz = getObjectSize(d);
+            liveSize += sz;
+            d += sz;
+        } else {
+            auto start = (RefBlock *)d;
+            auto sz = sweepDeadRun(d, end);
+            d += sz;
+            if (sz > 1 && !addClassFree(start, sz)) {
+                if (prevFree)
+                    prevFree->nextFree = start;
+                else
+                    firstFree = start;
+                prevFree = start;
+            }
+        }
+    }
+
+    if (prevFree)
+        prevFree->nextFree = nextFree;
+    else
+        firstFree = nextFree;
+    if (!nextFree && prevFree && sweepBlock)
+        sweepTail = prevFree;
+
+    gcStats.lastPromotedBytes = WORDS_TO_BYTES(liveSize);
+}
+
+// everything reachable that is left in the nursery gets promoted in place
+static void minorGC() {
+    startPerfCounter(PerfCounters::GC);
+    auto t0 = current_time_us();
+    GC_CHECK(!(inGC & IN_GC_COLLECT), 40);
+    inGC |= IN_GC_COLLECT | IN_GC_MINOR;
+    VLOG("minor GC: %d remembered", numRemembered);
+    sealNursery();
+    mark(0);
+    scanRemembered();
+    sweepNursery();
+    retireNursery();
+    gcStats.numMinorGC++;
+    inGC &= ~(IN_GC_COLLECT | IN_GC_MINOR);
+    notePause(t0);
+    stopPerfCounter(PerfCounters::GC);
+}
+
+#define NURSERY_MAX_OBJ_WORDS (BYTES_TO_WORDS(GC_NURSERY_SIZE) / 4)
+
+static void *nurseryAllocate(size_t numwords) {
+    if (nurseryPtr + WORDS_TO_BYTES(numwords) > nurseryEnd) {
+        if (nurseryStart)
+            minorGC();
+        if (!carveNursery())
+            return NULL;
+    }
+    auto p = (RefObject *)nurseryPtr;
+    nurseryPtr += WORDS_TO_BYTES(numwords);
+    p->setVT(0);
+    return p;
+}
+#endif
+
+#if defined(PXT_GC_NURSERY) || defined(PXT_GC_INCREMENTAL)
+void gcWriteBarrier(RefObject *holder, TValue v) {
+#ifdef PXT_GC_INCREMENTAL
+    if (incMarking)
+        gcScan(v);
+#else
+    if (IN_NURSERY(v) && !IN_NURSERY(holder))
+        remember((uintptr_t)holder);
+#endif
+}
+
+void gcWriteBarrierArray(void *data, TValue v) {
+#ifdef PXT_GC_INCREMENTAL
+    if (incMarking)
+        gcScan(v);
+#else
+    auto hd = (uintptr_t *)data - 1;
+    if (IN_NURSERY(v) && !IN_NURSERY(hd))
+        remember((uintptr_t)hd | REM_ARRAY);
+#endif
+}
+
+void gcAttachArray(RefObject *holder, void *data) {
+#ifdef PXT_GC_INCREMENTAL
+    gcRememberArray(data);
+#else
+    if (IN_NURSERY(data) && !IN_NURSERY(holder))
+        remember((uintptr_t)holder);
+#endif
+}
+
+void gcRememberArray(void *data) {
+    auto hd = (uintptr_t *)data - 1;
+#ifdef PXT_GC_INCREMENTAL
+    // the contents come from an array that is either already scanned, or will be through
+    // the owner, so it's enough to keep the new array
+    if (incMarking && !IS_MARKED(*hd))
+        MARK(hd);
+#else
+    if (nurseryStart)
+        remember((uintptr_t)hd | REM_ARRAY);
+#endif
+}
+#endif
+
+#ifdef PXT_GC_INCREMENTAL
+static void startIncrementalMark() {
+    // marking needs the previous sweep to be done
+    if (incMarking || sweepBlock)
+        return;
+    auto t0 = current_time_us();
+    VLOG("GC start incremental mark");
+    incMarking = true;
+    inGC |= IN_GC_COLLECT | IN_GC_SHADE;
+    mark(0);
+    inGC &= ~(IN_GC_COLLECT | IN_GC_SHADE);
+    notePause(t0);
+}
+
+// returns true when there are no more gray objects
+static bool markSome(uint64_t deadline) {
+    for (unsigned n = 0;; ++n) {
+        // don't stop with a partially scanned array, the mutator could shift its elements
+        if (!pendingArrays && !(n & 15) && current_time_us() >= deadline)
+            return false;
+        if (workQueue.getLength()) {
+            auto curr = (RefObject *)workQueue.pop();
+            auto scan = getScanMethod(curr->vt() & ~ANY_MARKED_MASK);
+            if (scan)
+                scan(curr);
+        } else if (pendingArrays) {
+            auto pa = pendingArrays;
+            pendingArrays = pa->next;
+            auto data = pa->data;
+            auto len = pa->len;
+            xfree(pa);
+            gcScanMany(data, len);
+        } else {
+            return true;
+        }
+    }
+}
+#endif
+
+void gcIncrementalStep(unsigned budgetUs) {
+#ifdef PXT_GC_INCREMENTAL
+    if (!incMarking || inGC)
+        return;
+    startPerfCounter(PerfCounters::GC);
+    auto t0 = current_time_us();
+    inGC |= IN_GC_COLLECT;
+    auto done = markSome(t0 + budgetUs);
+    inGC &= ~IN_GC_COLLECT;
+    notePause(t0);
+    stopPerfCounter(PerfCounters::GC);
+    // rescan roots and sweep
+    if (done)
+        gc(0);
+#endif
+}
+
 void gc(int flags) {
     startPerfCounter(PerfCounters::GC);
+    auto t0 = current_time_us();
     GC_CHECK(!(inGC & IN_GC_COLLECT), 40);
     inGC |= IN_GC_COLLECT;
+    // marking needs the previous sweep to be done
+    if (sweepBlock)
+        sweepStep(0xffffffff);
+#ifdef PXT_GC_NURSERY
+    // the nursery is swept with the rest of the heap
+    sealNursery();
+#endif
     VLOG("GC mark");
+#ifdef PXT_GC_INCREMENTAL
+    if (incMarking) {
+        // finish what was grayed so far; the roots are then rescanned below
+        processQueue();
+    }
+#endif
     mark(flags);
+#ifdef PXT_GC_INCREMENTAL
+    incMarking = false;
+#endif
     VLOG("GC sweep");
+#ifdef PXT_GC_LAZY_SWEEP
+    startSweep(flags);
+    // when stats were requested, print them now
+    if (flags)
+        sweepStep(0xffffffff);
+#else
     sweep(flags);
+#endif
+#ifdef PXT_GC_NURSERY
+    retireNursery();
+#endif
     VLOG("GC done");
+    notePause(t0);
     stopPerfCounter(PerfCounters::GC);
     inGC &= ~IN_GC_COLLECT;
 }
@@ -637,6 +1277,8 @@ void *gcAllocateArray(int numbytes) {
 
 static void *gcAllocAt(void *hint, int numbytes) {
     gc(0);
+    if (sweepBlock)
+        sweepStep(0xffffffff);
     size_t numwords = BYTES_TO_WORDS(ALIGN_TO_WORD(numbytes));
 
     for (auto p = firstFree; p; p = p->nextFree) {
@@ -702,6 +1344,19 @@ void gcReset() {
 
     gcRoots.setLength(0);
 
+#ifdef PXT_GC_INCREMENTAL
+    // drop any marking in progress
+    if (incMarking) {
+        incMarking = false;
+        workQueue.setLength(0);
+        while (pendingArrays) {
+            auto pa = pendingArrays;
+            pendingArrays = pa->next;
+            xfree(pa);
+        }
+    }
+#endif
+
     if (inGC)
         oops(41);
 
@@ -710,6 +1365,12 @@ void gcReset() {
 
     memset(&gcStats, 0, sizeof(gcStats));
     firstFree = NULL;
+    sweepBlock = NULL;
+    memset(classFree, 0, sizeof(classFree));
+#ifdef PXT_GC_NURSERY
+    retireNursery();
+    nurseryBlocked = false;
+#endif
     for (auto h = firstBlock; h; h = h->next) {
         setupFreeBlock(h);
     }
@@ -745,17 +1406,54 @@ void *gcAllocate(int numbytes) {
     }
 #endif
 
+    if (sampleInterval && !--sampleCountdown)
+        sampleAllocation(numbytes, __builtin_return_address(0));
+
 #ifdef PXT_GC_STRESS
     gc(0);
 #endif
 
+#ifdef PXT_GC_NURSERY
+    if (numwords <= NURSERY_MAX_OBJ_WORDS) {
+        auto r = nurseryAllocate(numwords);
+        if (r) {
+            inGC &= ~IN_GC_ALLOC;
+            return r;
+        }
+    }
+#endif
+
+    if (sweepBlock) {
+        auto t0 = current_time_us();
+        sweepStep(GC_SWEEP_BUDGET);
+        notePause(t0);
+    }
+
+    if (GC_MIN_CLASS_WORDS <= numwords && numwords <= GC_MAX_CLASS_WORDS) {
+        auto p = allocClassFree(numwords);
+        if (p) {
+            p->setVT(0);
+#ifdef PXT_GC_NURSERY
+            if (nurseryStart)
+                remember((uintptr_t)p | REM_NEW);
+#endif
+            inGC &= ~IN_GC_ALLOC;
+            return p;
+        }
+    }
+
     for (int i = 0;; ++i) {
         RefBlock *prev = NULL;
         for (auto p = firstFree; p; p = p->nextFree) {
             VVLOG("p=%p", p);
-            if (i == 0 && (uint8_t *)p > midPtr) {
+            if (i == 0 && !sweepBlock && (uint8_t *)p > midPtr) {
+#ifdef PXT_GC_INCREMENTAL
+                // start marking in the background, and keep allocating for now
+                startIncrementalMark();
+#else
                 VLOG("past midptr %p; gc", midPtr);
                 break;
+#endif
             }
             GC_CHECK(!isReadOnly((TValue)p), 49);
             auto vt = p->vtable;
@@ -778,16 +1476,32 @@ void *gcAllocate(int numbytes) {
                     prev->nextFree = nf;
                 else
                     firstFree = nf;
+                if (p == sweepTail)
+                    sweepTail = nf ? nf : prev;
                 p->setVT(0);
                 VVLOG("GC=>%p %d %p -> %p,%p", p, numwords, nf, nf ? nf->nextFree : 0,
                       nf ? (void *)nf->vtable : 0);
                 GC_CHECK(!nf || !nf->nextFree || !isReadOnly((TValue)nf->nextFree), 48);
+#ifdef PXT_GC_NURSERY
+                // it may get initialized with pointers to the nursery
+                if (nurseryStart)
+                    remember((uintptr_t)p | REM_NEW);
+#endif
                 inGC &= ~IN_GC_ALLOC;
                 return p;
             }
             prev = p;
         }
 
+        // finish sweeping before collecting again
+        if (sweepBlock) {
+            auto t0 = current_time_us();
+            sweepStep(GC_SWEEP_BUDGET);
+            notePause(t0);
+            --i;
+            continue;
+        }
+
         // we didn't find anything, try GC
         if (i == 0)
             gc(0);
@@ -858,6 +1572,10 @@ void unregisterGCPtr(TValue ptr) {
 
 void RefImage::scan(RefImage *t) {
     gcScan((TValue)t->buffer);
+    if (t->collisionMask)
+        gcMarkArray(t->collisionMask);
+    if (t->opaqueSpans)
+        gcMarkArray(t->opaqueSpans);
 }
 
 void RefCollection::scan(RefCollection *t) {
@@ -875,6 +1593,8 @@ void RefRefLocal::scan(RefRefLocal *t) {
 void RefMap::scan(RefMap *t) {
     gcScanSegment(t->keys);
     gcScanSegment(t->values);
+    if (t->index)
+        gcMarkArray(t->index);
 }
 
 void RefRecord_scan(RefRecord *r) {
@@ -11,6 +11,13 @@ namespace control {
         lastFreeBytes: number;
         lastMaxBlockBytes: number;
         minFreeBytes: number;
+        numMinorGC: number;
+        lastPromotedBytes: number;
+        // allocations served from the free lists for minClassWords, ..., maxClassWords words
+        minClassWords: number;
+        maxClassWords: number;
+        sizeClassHits: number[];
+        maxPauseUs: number;
     }
 
     /**
@@ -29,6 +36,16 @@ namespace control {
         addField("lastFreeBytes")
         addField("lastMaxBlockBytes")
         addField("minFreeBytes")
+        addField("numMinorGC")
+        addField("lastPromotedBytes")
+        addField("minClassWords")
+        addField("maxClassWords")
+        res.sizeClassHits = []
+        for (let i = res.minClassWords; i <= res.maxClassWords; ++i) {
+            res.sizeClassHits.push(buf.getNumber(NumberFormat.UInt32LE, off))
+            off += 4
+        }
+        addField("maxPauseUs")
 
         return res
 
@@ -36,5 +53,41 @@ namespace control {
             res[name] = buf.getNumber(NumberFormat.UInt32LE, off)
             off += 4
         }
-    }    
+    }
+
+    //% shim=pxt::getGCCensus
+    function getGCCensus(): Buffer {
+        return null
+    }
+
+    //% shim=pxt::setGCAllocSampling
+    function setGCAllocSampling(interval: number): void { }
+
+    //% shim=pxt::getGCAllocSamples
+    function getGCAllocSamples(): Buffer {
+        return null
+    }
+
+    /**
+     * Run the GC and return live objects per type, as UInt32LE triples of
+     * class number (0 for arrays, 0xffff for other), number of objects and number of bytes.
+     */
+    export function gcCensus(): Buffer {
+        return getGCCensus()
+    }
+
+    /**
+     * Record size and location of every n-th allocation; 0 disables sampling.
+     */
+    export function gcSampleAllocations(interval: number) {
+        setGCAllocSampling(interval)
+    }
+
+    /**
+     * Get recently sampled allocations, oldest first, as size in bytes followed by
+     * 4 code locations. These are UInt32LE in the VM, and pointer-sized in native builds.
+     */
+    export function gcAllocSamples(): Buffer {
+        return getGCAllocSamples()
+    }
 }
\ No newline at end of file
@@ -55,12 +55,14 @@ TValue RefRecord::ldref(int idx) {
 void RefRecord::st(int idx, TValue v) {
     // intcheck((reflen == 255 ? 0 : reflen) <= idx && idx < len, PANIC_OUT_OF_BOUNDS, 3);
     fields[idx] = v;
+    gcWriteBarrier(this, v);
 }
 
 void RefRecord::stref(int idx, TValue v) {
     // DMESG("ST %p len=%d reflen=%d idx=%d", this, len, reflen, idx);
     // intcheck(0 <= idx && idx < reflen, PANIC_OUT_OF_BOUNDS, 4);
     fields[idx] = v;
+    gcWriteBarrier(this, v);
 }
 
 void RefObject::destroyVT() {
@@ -91,6 +93,7 @@ void Segment::set(unsigned i, TValue value) {
     } else {
         return;
     }
+    gcWriteBarrierArray(data, value);
     if (length <= i) {
         length = i + 1;
     }
@@ -190,6 +193,8 @@ void Segment::growByMin(ramint_t minSize) {
 
         data = tmp;
         size = newSize;
+        // we don't know who owns us, so keep the new array around until the next GC
+        gcRememberArray(data);
 
 #ifdef DEBUG_BUILD
         DMESG("growBy - after reallocation");
@@ -269,6 +274,7 @@ void Segment::insert(unsigned i, TValue value) {
         memmove(data + i + 1, data + i, (length - i) * sizeof(void *));
 
         data[i] = value;
+        gcWriteBarrierArray(data, value);
         length++;
     } else {
         // This is insert beyond the length, just call set which will adjust the length
@@ -334,15 +340,118 @@ void RefRefLocal::destroy(RefRefLocal *t) {
     decr(t->v);
 }
 
-PXT_VTABLE_CTOR(RefMap) {}
+PXT_VTABLE_CTOR(RefMap) {
+    index = NULL;
+    indexMask = 0;
+}
 
 void RefMap::destroy(RefMap *t) {
     t->keys.destroy();
     t->values.destroy();
+    t->index = NULL;
+    t->indexMask = 0;
+}
+
+static uint32_t mapKeyHash(String key) {
+    return hash_fnv1(key->getUTF8Data(), key->getUTF8Size());
+}
+
+static bool mapKeyEq(String a, String b) {
+    if (a == b)
+        return true;
+    auto len = b->getUTF8Size();
+    return a->getUTF8Size() == len && memcmp(a->getUTF8Data(), b->getUTF8Data(), len) == 0;
+}
+
+void RefMap::buildIndex() {
+    auto len = keys.getLength();
+    uint32_t size = 2 * PXT_MAP_INDEX_THRESHOLD;
+    while (size < len * 2)
+        size <<= 1;
+
+    // set it right away, so it's kept alive if hashing needs to allocate
+    index = (uint32_t *)gcAllocateArray(size * sizeof(uint32_t));
+    indexMask = size - 1;
+    gcAttachArray(this, index);
+    memset(index, 0, size * sizeof(uint32_t));
+
+    for (unsigned i = 0; i < len; ++i) {
+        auto h = mapKeyHash((String)keys.get(i)) & indexMask;
+        while (index[h])
+            h = (h + 1) & indexMask;
+        index[h] = i + 1;
+    }
+}
+
+void RefMap::addToIndex(unsigned i) {
+    if (!index)
+        return; // built lazily in findIdx()
+    // keep load factor under 1/2
+    if ((i + 1) * 2 > indexMask + 1) {
+        buildIndex();
+        return;
+    }
+    auto h = mapKeyHash((String)keys.get(i)) & indexMask;
+    while (index[h])
+        h = (h + 1) & indexMask;
+    index[h] = i + 1;
+}
+
+void RefMap::removeFromIndex(unsigned i) {
+    if (!index)
+        return;
+
+    // keys after i were shifted down by one
+    int hole = -1;
+    for (unsigned h = 0; h <= indexMask; ++h) {
+        auto v = index[h];
+        if (v == i + 1)
+            hole = h;
+        else if (v > i + 1)
+            index[h] = v - 1;
+    }
+    if (hole < 0)
+        oops(56);
+
+    // backward-shift deletion, so that lookups don't need tombstones
+    unsigned j = hole;
+    for (;;) {
+        index[j] = 0;
+        unsigned k = j;
+        for (;;) {
+            k = (k + 1) & indexMask;
+            if (!index[k])
+                return;
+            auto home = mapKeyHash((String)keys.get(index[k] - 1)) & indexMask;
+            // the entry at k can only move to j if its home is not in (j, k]
+            bool stays = j <= k ? (j < home && home <= k) : (j < home || home <= k);
+            if (!stays)
+                break;
+        }
+        index[j] = index[k];
+        j = k;
+    }
 }
 
 int RefMap::findIdx(String key) {
     auto len = keys.getLength();
+
+    if (!index && len >= PXT_MAP_INDEX_THRESHOLD)
+        buildIndex();
+
+    if (index) {
+        auto h = mapKeyHash(key) & indexMask;
+        auto data = (String *)keys.getData();
+        for (;;) {
+            auto v = index[h];
+            if (!v)
+                return -1;
+            if (mapKeyEq(data[v - 1], key))
+                return v - 1;
+            h = (h + 1) & indexMask;
+        }
+    }
+
     auto data = (String *)keys.getData();
 
     // fast path
@@ -511,6 +620,7 @@ TValue mapDeleteByString(RefMap *map, String key) {
     if (i >= 0) {
         map->keys.remove(i);
         map->values.remove(i);
+        map->removeFromIndex(i);
     }
     return TAG_TRUE;
 }
@@ -527,6 +527,23 @@ class RefObject {
     inline bool isReadOnly() { return pxt::isReadOnly((TValue)this); }
 };
 
+#if defined(PXT_GC_NURSERY) || defined(PXT_GC_INCREMENTAL)
+// Generational and incremental GC: stores of heap pointers into objects/arrays have to go
+// through these, so that minor collections and incremental marking can see them.
+void gcWriteBarrier(RefObject *holder, TValue v);
+void gcWriteBarrierArray(void *data, TValue v);
+// holder now points to a freshly allocated array (not containing TValues)
+void gcAttachArray(RefObject *holder, void *data);
+// keep a freshly allocated array of TValues alive until the next collection; used when
+// the owner of the array is not known
+void gcRememberArray(void *data);
+#else
+static inline void gcWriteBarrier(RefObject *, TValue) {}
+static inline void gcWriteBarrierArray(void *, TValue) {}
+static inline void gcAttachArray(RefObject *, void *) {}
+static inline void gcRememberArray(void *) {}
+#endif
+
 class Segment {
   private:
     TValue *data;
@@ -602,10 +619,18 @@ class RefCollection : public RefObject {
     TValue *getData() { return head.getData(); }
 };
 
+// maps get a hash index once they have that many keys
+#ifndef PXT_MAP_INDEX_THRESHOLD
+#define PXT_MAP_INDEX_THRESHOLD 16
+#endif
+
 class RefMap : public RefObject {
   public:
     Segment keys;
     Segment values;
+    // open-addressing hash table of (position in keys + 1), 0 is empty; GC array or NULL
+    uint32_t *index;
+    uint32_t indexMask;
 
     RefMap();
     static void destroy(RefMap *map);
@@ -613,6 +638,12 @@ class RefMap : public RefObject {
     static unsigned gcsize(RefMap *coll);
     static void print(RefMap *map);
     int findIdx(BoxedString *key);
+    // keep index in sync after keys.push() and keys.remove()
+    void addToIndex(unsigned i);
+    void removeFromIndex(unsigned i);
+
+  private:
+    void buildIndex();
 };
 
 // A ref-counted, user-defined JS object.
@@ -681,6 +712,7 @@ class RefAction : public RefObject {
         intcheck(0 <= idx && idx < len, PANIC_OUT_OF_BOUNDS, 10);
         intcheck(fields[idx] == 0, PANIC_OUT_OF_BOUNDS, 11); // only one assignment permitted
         fields[idx] = v;
+        gcWriteBarrier(this, v);
     }
 };
 
@@ -817,6 +849,16 @@ class RefImage : public RefObject {
   public:
     BoxedBuffer *buffer;
     uint32_t revision;
+    // bounding box of pixels changed since last clearDirty(); x0 >= x1 when clean
+    // (not clipped, see getDirty())
+    int16_t dirtyX0, dirtyY0, dirtyX1, dirtyY1;
+    // 1 bit per non-transparent pixel, (height + 31) / 32 words per column; GC array or NULL
+    uint32_t *collisionMask;
+    // revision the collisionMask was computed for
+    uint32_t maskRevision;
+    // opaque runs per column of a read-only image; GC array or NULL
+    uint16_t *opaqueSpans;
+    bool spansChecked;
 
     RefImage(BoxedBuffer *buf);
     RefImage(uint32_t sz);
@@ -863,7 +905,17 @@ class RefImage : public RefObject {
     uint8_t fillMask(color c);
     bool inRange(int x, int y);
     void clamp(int *x, int *y);
+    // marks the whole image as dirty
     void makeWritable();
+    // marks only given rectangle as dirty
+    void makeWritable(int x, int y, int w, int h);
+    void markDirty(int x, int y, int w, int h);
+    void clearDirty() {
+        dirtyX0 = dirtyY0 = 0;
+        dirtyX1 = dirtyY1 = 0;
+    }
+    // get dirty rectangle clipped to the image; returns false if nothing changed
+    bool getDirty(int *x, int *y, int *w, int *h);
 
     static void destroy(RefImage *t);
     static void scan(RefImage *t);
@@ -872,6 +924,8 @@ class RefImage : public RefObject {
 };
 
 RefImage *mkImage(int w, int h, int bpp);
+// call fn(ctx, x0, x1) for disjoint bands of columns covering [0, width), possibly in parallel
+void runColumnBands(int width, void (*fn)(void *ctx, int x0, int x1), void *ctx);
 
 typedef BoxedBuffer *Buffer;
 typedef BoxedString *String;
@@ -905,6 +959,12 @@ String mkString(const char *data, int len = -1);
 // data can be NULL in both cases
 Buffer mkBuffer(const void *data, int len);
 String mkStringCore(const char *data, int len = -1);
+#if PXT_UTF8
+// character code at data, as returned by String.charCodeAt()
+int utf8CharCode(const char *data);
+// pointer to character number skip, or NULL when past the end
+const char *utf8Skip(const char *data, int size, int skip);
+#endif
 
 TNumber getNumberCore(uint8_t *buf, int size, NumberFormat format);
 void setNumberCore(uint8_t *buf, int size, NumberFormat format, TNumber value);
@@ -932,6 +992,22 @@ static inline void unregisterGCObj(RefObject *ptr) {
     unregisterGCPtr((TValue)ptr);
 }
 void gc(int flags);
+Buffer getGCCensus();
+// each sample is the size in bytes followed by GC_SAMPLE_DEPTH code locations, all gcsample_t
+Buffer getGCAllocSamples();
+#ifndef GC_SAMPLE_DEPTH
+#define GC_SAMPLE_DEPTH 4
+#endif
+#ifdef PXT_VM
+typedef uint32_t gcsample_t; // word offsets in the image
+#else
+typedef uintptr_t gcsample_t; // return addresses
+#endif
+// with PXT_GC_INCREMENTAL, does up to budgetUs of marking work when marking is in progress
+void gcIncrementalStep(unsigned budgetUs);
+#ifndef PXT_GC_MARK_BUDGET_US
+#define PXT_GC_MARK_BUDGET_US 1000
+#endif
 
 struct StackSegment {
     void *top;
@@ -975,6 +1051,8 @@ void gcFreeze();
 #ifdef PXT_VM
 void gcStartup();
 void gcPreStartup();
+// fills dst with current and return program counters of the current fiber
+int vmCaptureStack(uint32_t *dst, int max);
 #endif
 
 void coreReset();
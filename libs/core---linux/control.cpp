@@ -23,6 +23,17 @@ int allocateNotifyEvent() {
     return pxt::allocateNotifyEvent();
 }
 
+// getEventStats() is implemented by both linux.cpp and the VM scheduler.cpp; this file is
+// shared by core---vm.
+/**
+ * Get statistics of the event queue, as UInt32LE numbers: events raised, events dropped because
+ * the queue was full, most events queued at once, and the queue size.
+ */
+//%
+Buffer eventQueueStats() {
+    return pxt::getEventStats();
+}
+
 /**
 * Determine the version of system software currently running.
 */
@@ -43,6 +54,38 @@ void dmesg(String s) {
     DMESG("# %s", s->getUTF8Data());
 }
 
+/**
+ * Run GC and write a census of live objects per type, and any sampled allocations, to a file.
+ */
+//%
+void dumpHeapCensus(String filename) {
+    auto f = fopen(filename->getUTF8Data(), "w");
+    if (!f) {
+        DMESG("can't write %s", filename->getUTF8Data());
+        return;
+    }
+
+    auto census = pxt::getGCCensus();
+    registerGCObj(census);
+    auto samples = pxt::getGCAllocSamples();
+    unregisterGCObj(census);
+
+    fprintf(f, "# class objects bytes\n");
+    auto p = (uint32_t *)census->data;
+    for (unsigned i = 0; i + 3 <= (unsigned)census->length / 4; i += 3)
+        fprintf(f, "%u %u %u\n", p[i], p[i + 1], p[i + 2]);
+
+    fprintf(f, "# sampled allocations: bytes locations...\n");
+    auto s = (gcsample_t *)samples->data;
+    unsigned words = samples->length / sizeof(gcsample_t);
+    unsigned rec = 1 + GC_SAMPLE_DEPTH;
+    for (unsigned i = 0; i < words; ++i)
+        fprintf(f, (i + 1) % rec == 0 ? "0x%lx\n" : i % rec == 0 ? "%lu" : " 0x%lx",
+                (unsigned long)s[i]);
+
+    fclose(f);
+}
+
 //%
 uint32_t _ramSize()
 {
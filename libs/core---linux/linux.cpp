@@ -25,6 +25,26 @@
 
 #define THREAD_DBG(...)
 
+// Event handlers and runInParallel() run as fibers (user-space threads with their own stacks) on
+// the main thread. Define PXT_LINUX_PTHREADS to run each of them in a pthread instead.
+#ifndef PXT_LINUX_PTHREADS
+#define PXT_LINUX_FIBERS 1
+#include <ucontext.h>
+#endif
+
+// address space reserved for a fiber stack; pages are only allocated when touched
+#define FIBER_STACK_SIZE (1024 * 1024)
+#define FIBER_GUARD_SIZE 4096
+// number of stacks of finished fibers kept for reuse
+#define FIBER_STACK_POOL 32
+
+// events raised but not dispatched yet; further events are dropped (power of 2)
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 256
+#endif
+// buckets of threads waiting for events, by source and value (power of 2)
+#define WAITER_BUCKETS 64
+
 #define MALLOC_LIMIT (8 * 1024 * 1024)
 #define MALLOC_CHECK_PERIOD (1024 * 1024)
 
@@ -74,30 +94,50 @@ struct Thread {
     TValue arg0;
     TValue data0;
     TValue data1;
+#ifdef PXT_LINUX_FIBERS
+    void (*runner)(Thread *);
+    ThreadContext *ctx;
+    ucontext_t uctx;
+    // NULL for the main thread, which runs on the process stack
+    uint8_t *stack;
+    uint64_t wakeTime;
+    bool finished;
+#else
     pthread_t pid;
     pthread_cond_t waitCond;
+#endif
     int waitSource;
     int waitValue;
+    // next thread in the same waiters[] bucket
+    struct Thread *nextWaiter;
 };
 
 static struct Thread *allThreads;
-static struct Event *eventHead, *eventTail;
 
 struct Event {
-    struct Event *next;
     int source;
     int value;
 };
 
-Event lastEvent;
+// keep in sync with core---vm/scheduler.cpp
+struct EventStats {
+    uint32_t numEvents;
+    // events dropped because the queue was full
+    uint32_t numOverflow;
+    // most events queued at once
+    uint32_t highWater;
+    uint32_t queueSize;
+};
 
-Event *mkEvent(int source, int value) {
-    auto res = new Event();
-    memset(res, 0, sizeof(Event));
-    res->source = source;
-    res->value = value;
-    return res;
-}
+// ring buffer written by raiseEvent() from any thread, read by the dispatcher;
+// eventHead and eventTail only grow, and are protected by eventMutex
+static Event eventQueue[EVENT_QUEUE_SIZE];
+static unsigned eventHead, eventTail;
+static EventStats eventStats;
+
+static Thread *waiters[WAITER_BUCKETS];
+
+Event lastEvent;
 
 volatile bool paniced;
 extern "C" void drawPanic(int code);
@@ -143,7 +183,21 @@ void sleep_core_us(uint64_t us) {
         ;
 }
 
+#ifdef PXT_LINUX_FIBERS
+static Thread *currentThread;
+static void yieldFiber();
+#endif
+
 void sleep_ms(uint32_t ms) {
+#ifdef PXT_LINUX_FIBERS
+    if (currentThread) {
+        currentThread->wakeTime = current_time_us() + ms * 1000ULL;
+        if (!currentThread->wakeTime)
+            currentThread->wakeTime = 1;
+        yieldFiber();
+        return;
+    }
+#endif
     stopUser();
     sleep_core_us(ms * 1000);
     startUser();
@@ -171,6 +225,32 @@ int current_time_ms() {
     return current_time_us() / 1000;
 }
 
+#ifdef PXT_LINUX_FIBERS
+static uint8_t *stackPool[FIBER_STACK_POOL];
+static int stackPoolSize;
+
+static uint8_t *allocStack() {
+    if (stackPoolSize)
+        return stackPool[--stackPoolSize];
+    auto r = (uint8_t *)mmap(NULL, FIBER_GUARD_SIZE + FIBER_STACK_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (r == MAP_FAILED) {
+        DMESG("fiber stack mmap failed; err=%d", errno);
+        target_panic(PANIC_INTERNAL_ERROR);
+    }
+    // stacks grow down, so overflow hits the guard page
+    mprotect(r, FIBER_GUARD_SIZE, PROT_NONE);
+    return r;
+}
+
+static void freeStack(uint8_t *stack) {
+    if (stackPoolSize < FIBER_STACK_POOL)
+        stackPool[stackPoolSize++] = stack;
+    else
+        munmap(stack, FIBER_GUARD_SIZE + FIBER_STACK_SIZE);
+}
+#endif
+
 void disposeThread(Thread *t) {
     if (allThreads == t) {
         allThreads = t->next;
@@ -183,32 +263,80 @@ void disposeThread(Thread *t) {
         }
     }
     unregisterGC(&t->act, 4);
+#ifdef PXT_LINUX_FIBERS
+    if (t->stack)
+        freeStack(t->stack);
+#else
     pthread_cond_destroy(&t->waitCond);
+#endif
     delete t;
 }
 
 static void runAct(Thread *thr) {
+#ifdef PXT_LINUX_FIBERS
+    // the scheduler disposes of the fiber
+    pxt::runAction1(thr->act, thr->arg0);
+#else
     startUser();
     pxt::runAction1(thr->act, thr->arg0);
     stopUser();
     disposeThread(thr);
+#endif
 }
 
 static void mainThread(Thread *) {}
 
+#ifdef PXT_LINUX_FIBERS
+static ucontext_t schedulerCtx;
+// fiber run last; the scheduler continues with the one after it
+static Thread *lastRun;
+
+static void yieldFiber() {
+    swapcontext(&currentThread->uctx, &schedulerCtx);
+}
+
+static void fiberEntry() {
+    auto t = currentThread;
+    t->runner(t);
+    t->finished = true;
+    yieldFiber();
+}
+#endif
+
 void setupThread(Action a, TValue arg = 0, void (*runner)(Thread *) = NULL, TValue d0 = 0,
                  TValue d1 = 0) {
     if (runner == NULL)
         runner = runAct;
     auto thr = new Thread();
     memset(thr, 0, sizeof(Thread));
-    thr->next = allThreads;
-    allThreads = thr;
+    // add at the end, so that threads are run (and woken up) in order of creation
+    if (allThreads) {
+        auto p = allThreads;
+        while (p->next)
+            p = p->next;
+        p->next = thr;
+    } else {
+        allThreads = thr;
+    }
     registerGC(&thr->act, 4);
     thr->act = a;
     thr->arg0 = arg;
     thr->data0 = d0;
     thr->data1 = d1;
+#ifdef PXT_LINUX_FIBERS
+    if (runner == mainThread) {
+        currentThread = thr;
+    } else {
+        thr->runner = runner;
+        thr->stack = allocStack();
+        getcontext(&thr->uctx);
+        thr->uctx.uc_stack.ss_sp = thr->stack + FIBER_GUARD_SIZE;
+        thr->uctx.uc_stack.ss_size = FIBER_STACK_SIZE;
+        thr->uctx.uc_link = NULL;
+        makecontext(&thr->uctx, fiberEntry, 0);
+        THREAD_DBG("setup fiber: %p", thr);
+    }
+#else
     pthread_cond_init(&thr->waitCond, NULL);
     if (runner == mainThread) {
         thr->pid = pthread_self();
@@ -217,11 +345,17 @@ void setupThread(Action a, TValue arg = 0, void (*runner)(Thread *) = NULL, TVal
         THREAD_DBG("setup thread: %p (pid %p)", thr, thr->pid);
         pthread_detach(thr->pid);
     }
+#endif
 }
 
 void releaseFiber() {
+#ifdef PXT_LINUX_FIBERS
+    currentThread->finished = true;
+    yieldFiber();
+#else
     stopUser();
     pthread_exit(NULL);
+#endif
 }
 
 void runInParallel(Action a) {
@@ -229,7 +363,9 @@ void runInParallel(Action a) {
 }
 
 static void runFor(Thread *t) {
+#ifndef PXT_LINUX_FIBERS
     startUser();
+#endif
     while (true) {
         pxt::runAction0(t->act);
         sleep_ms(20);
@@ -240,8 +376,34 @@ void runForever(Action a) {
     setupThread(a, 0, runFor);
 }
 
+static Thread **waiterBucket(int source, int value) {
+    // all DEVICE_ID_NOTIFY waiters share one queue, so that NOTIFY_ONE can find the one waiting
+    // longest, whether it waits for a specific value or for DEVICE_EVT_ANY
+    if (source == DEVICE_ID_NOTIFY)
+        value = DEVICE_EVT_ANY;
+    return &waiters[(source * 31 + value) & (WAITER_BUCKETS - 1)];
+}
+
+static void addWaiter(Thread *t) {
+    // at the end, so that NOTIFY_ONE wakes up the thread waiting longest
+    auto p = waiterBucket(t->waitSource, t->waitValue);
+    while (*p)
+        p = &(*p)->nextWaiter;
+    t->nextWaiter = NULL;
+    *p = t;
+}
+
 void waitForEvent(int source, int value) {
     THREAD_DBG("waitForEv: %d %d", source, value);
+#ifdef PXT_LINUX_FIBERS
+    if (currentThread) {
+        currentThread->waitSource = source;
+        currentThread->waitValue = value;
+        addWaiter(currentThread);
+        yieldFiber();
+        return;
+    }
+#else
     auto self = pthread_self();
     for (auto t = allThreads; t; t = t->next) {
         THREAD_DBG("t: %p", t);
@@ -249,6 +411,7 @@ void waitForEvent(int source, int value) {
             pthread_mutex_lock(&eventMutex);
             t->waitSource = source;
             t->waitValue = value;
+            addWaiter(t);
             stopUser();
             // spourious wake ups may occur they say
             while (t->waitSource) {
@@ -259,6 +422,7 @@ void waitForEvent(int source, int value) {
             return;
         }
     }
+#endif
     DMESG("current thread not registered!");
     oops(52);
 }
@@ -273,41 +437,153 @@ static void dispatchEvent(Event &e) {
     }
 }
 
+static void wakeThread(Thread *thr) {
+    thr->waitSource = 0; // once!
+#ifndef PXT_LINUX_FIBERS
+    pthread_cond_broadcast(&thr->waitCond);
+#endif
+}
+
+// wake up threads waiting for exactly this source and value
+static void wakeWaiters(int source, int value) {
+    auto p = waiterBucket(source, value);
+    while (*p) {
+        auto t = *p;
+        if (t->waitSource == source && t->waitValue == value) {
+            *p = t->nextWaiter;
+            t->nextWaiter = NULL;
+            wakeThread(t);
+        } else {
+            p = &t->nextWaiter;
+        }
+    }
+}
+
+// wake up the thread waiting longest on DEVICE_ID_NOTIFY for this value or DEVICE_EVT_ANY
+static void wakeOneNotifyWaiter(int value) {
+    for (auto p = waiterBucket(DEVICE_ID_NOTIFY, value); *p; p = &(*p)->nextWaiter) {
+        auto t = *p;
+        if (t->waitSource == DEVICE_ID_NOTIFY &&
+            (t->waitValue == value || t->waitValue == DEVICE_EVT_ANY)) {
+            *p = t->nextWaiter;
+            t->nextWaiter = NULL;
+            wakeThread(t);
+            return;
+        }
+    }
+}
+
+static void wakeThreads(Event *ev) {
+    wakeWaiters(ev->source, ev->value);
+    if (ev->value != DEVICE_EVT_ANY)
+        wakeWaiters(ev->source, DEVICE_EVT_ANY);
+    if (ev->source == DEVICE_ID_NOTIFY_ONE)
+        wakeOneNotifyWaiter(ev->value);
+}
+
+#ifdef PXT_LINUX_FIBERS
+static void wakeFibers() {
+    for (;;) {
+        pthread_mutex_lock(&eventMutex);
+        if (eventHead == eventTail) {
+            pthread_mutex_unlock(&eventMutex);
+            return;
+        }
+        Event ev = eventQueue[eventHead++ & (EVENT_QUEUE_SIZE - 1)];
+        pthread_mutex_unlock(&eventMutex);
+        wakeThreads(&ev);
+        dispatchEvent(ev);
+    }
+}
+
+// wait for an event, or until given time (if non-zero)
+static void waitIdle(uint64_t wakeTime) {
+    stopUser();
+    pthread_mutex_lock(&eventMutex);
+    if (eventHead == eventTail) {
+        if (wakeTime) {
+            uint64_t until = startTime + wakeTime;
+            struct timespec ts;
+            ts.tv_sec = until / 1000000;
+            ts.tv_nsec = (until % 1000000) * 1000;
+            pthread_cond_timedwait(&newEventBroadcast, &eventMutex, &ts);
+        } else {
+            pthread_cond_wait(&newEventBroadcast, &eventMutex);
+        }
+    }
+    pthread_mutex_unlock(&eventMutex);
+    startUser();
+}
+
+static void schedulerLoop() {
+    for (;;) {
+        wakeFibers();
+
+        auto now = current_time_us();
+        uint64_t nextWake = 0;
+        Thread *f = NULL;
+        auto start = lastRun && lastRun->next ? lastRun->next : allThreads;
+        auto p = start;
+        while (p) {
+            if (!p->finished && !p->waitSource) {
+                if (p->wakeTime && now >= p->wakeTime)
+                    p->wakeTime = 0;
+                if (!p->wakeTime) {
+                    f = p;
+                    break;
+                }
+                if (!nextWake || p->wakeTime < nextWake)
+                    nextWake = p->wakeTime;
+            }
+            p = p->next ? p->next : allThreads;
+            if (p == start)
+                break;
+        }
+
+        if (!f) {
+            waitIdle(nextWake);
+            continue;
+        }
+
+        currentThread = f;
+        lastRun = f;
+        swapcontext(&schedulerCtx, &f->uctx);
+        currentThread = NULL;
+
+        if (f->finished) {
+            if (lastRun == f)
+                lastRun = NULL;
+            disposeThread(f);
+        }
+    }
+}
+
+static void startScheduler() {
+    getcontext(&schedulerCtx);
+    schedulerCtx.uc_stack.ss_sp = allocStack() + FIBER_GUARD_SIZE;
+    schedulerCtx.uc_stack.ss_size = FIBER_STACK_SIZE;
+    schedulerCtx.uc_link = NULL;
+    makecontext(&schedulerCtx, schedulerLoop, 0);
+}
+#else
 static void *evtDispatcher(void *dummy) {
     pthread_mutex_lock(&eventMutex);
     while (true) {
         pthread_cond_wait(&newEventBroadcast, &eventMutex);
-        while (eventHead != NULL) {
+        while (eventHead != eventTail) {
+            if (paniced)
+                return 0;
+            Event ev = eventQueue[eventHead++ & (EVENT_QUEUE_SIZE - 1)];
+
+            wakeThreads(&ev);
             if (paniced)
                 return 0;
-            Event *ev = eventHead;
-            eventHead = ev->next;
-            if (eventHead == NULL)
-                eventTail = NULL;
-
-            for (auto thr = allThreads; thr; thr = thr->next) {
-                if (paniced)
-                    return 0;
-                if (thr->waitSource == 0)
-                    continue;
-                if (thr->waitValue != ev->value && thr->waitValue != DEVICE_EVT_ANY)
-                    continue;
-                if (thr->waitSource == ev->source) {
-                    thr->waitSource = 0; // once!
-                    pthread_cond_broadcast(&thr->waitCond);
-                } else if (thr->waitSource == DEVICE_ID_NOTIFY &&
-                           ev->source == DEVICE_ID_NOTIFY_ONE) {
-                    thr->waitSource = 0; // once!
-                    pthread_cond_broadcast(&thr->waitCond);
-                    break; // do not wake up any other threads
-                }
-            }
 
-            dispatchEvent(*ev);
-            delete ev;
+            dispatchEvent(ev);
         }
     }
 }
+#endif
 
 int allocateNotifyEvent() {
     static volatile int notifyId;
@@ -318,20 +594,30 @@ int allocateNotifyEvent() {
 }
 
 void raiseEvent(int id, int event) {
-    auto e = mkEvent(id, event);
     pthread_mutex_lock(&eventMutex);
-    if (eventTail == NULL) {
-        if (eventHead != NULL)
-            oops(51);
-        eventHead = eventTail = e;
+    unsigned len = eventTail - eventHead;
+    if (len >= EVENT_QUEUE_SIZE) {
+        eventStats.numOverflow++;
     } else {
-        eventTail->next = e;
-        eventTail = e;
+        auto e = &eventQueue[eventTail++ & (EVENT_QUEUE_SIZE - 1)];
+        e->source = id;
+        e->value = event;
+        eventStats.numEvents++;
+        if (len + 1 > eventStats.highWater)
+            eventStats.highWater = len + 1;
     }
     pthread_cond_broadcast(&newEventBroadcast);
     pthread_mutex_unlock(&eventMutex);
 }
 
+Buffer getEventStats() {
+    pthread_mutex_lock(&eventMutex);
+    auto stats = eventStats;
+    pthread_mutex_unlock(&eventMutex);
+    stats.queueSize = EVENT_QUEUE_SIZE;
+    return mkBuffer((uint8_t *)&stats, sizeof(stats));
+}
+
 void registerWithDal(int id, int event, Action a, int flags) {
     // TODO support flags
     setBinding(id, event, a);
@@ -353,9 +639,13 @@ void initRuntime() {
 
     target_startup();
 
+#ifdef PXT_LINUX_FIBERS
+    startScheduler();
+#else
     pthread_t disp;
     pthread_create(&disp, NULL, evtDispatcher, NULL);
     pthread_detach(disp);
+#endif
     setupThread(0, 0, mainThread);
     target_init();
     screen_init();
@@ -381,6 +671,17 @@ void *gcAllocBlock(size_t sz) {
     return r;
 }
 
+#ifdef PXT_LINUX_FIBERS
+ThreadContext *getThreadContext() {
+    return currentThread ? currentThread->ctx : NULL;
+}
+
+void setThreadContext(ThreadContext *ctx) {
+    if (!currentThread)
+        oops(52);
+    currentThread->ctx = ctx;
+}
+#else
 static __thread ThreadContext *threadCtx;
 
 ThreadContext *getThreadContext() {
@@ -390,7 +691,9 @@ ThreadContext *getThreadContext() {
 void setThreadContext(ThreadContext *ctx) {
     threadCtx = ctx;
 }
+#endif
 
+// every thread and fiber has its own stack, which doesn't move
 void *threadAddressFor(ThreadContext *, void *sp) {
     return sp;
 }
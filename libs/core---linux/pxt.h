@@ -18,6 +18,8 @@ typedef serial::LinuxSerialDevice *SerialDevice;
 namespace pxt {
 void raiseEvent(int id, int event);
 int allocateNotifyEvent();
+// EventStats of the event queue
+Buffer getEventStats();
 void sleep_core_us(uint64_t us);
 void startUser();
 void stopUser();
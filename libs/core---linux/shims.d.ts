@@ -18,9 +18,22 @@ declare namespace control {
     //% help=control/allocate-notify-event shim=control::allocateNotifyEvent
     function allocateNotifyEvent(): int32;
 
+    /**
+     * Get statistics of the event queue, as UInt32LE numbers: events raised, events dropped because
+     * the queue was full, most events queued at once, and the queue size.
+     */
+    //% shim=control::eventQueueStats
+    function eventQueueStats(): Buffer;
+
     /** Write data to DMESG debugging buffer. */
     //% shim=control::dmesg
     function dmesg(s: string): void;
+
+    /**
+     * Run GC and write a census of live objects per type, and any sampled allocations, to a file.
+     */
+    //% shim=control::dumpHeapCensus
+    function dumpHeapCensus(filename: string): void;
 }
 declare namespace serial {
 
@@ -14,6 +14,8 @@
 namespace pxt {
 void raiseEvent(int id, int event);
 int allocateNotifyEvent();
+// EventStats of the event queue
+Buffer getEventStats();
 void sleep_core_us(uint64_t us);
 
 void target_disable_irq();
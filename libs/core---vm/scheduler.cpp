@@ -22,6 +22,13 @@
 #define THROW throw()
 #define THREAD_DBG(...)
 
+// events raised but not dispatched yet; further events are dropped (power of 2)
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 256
+#endif
+// buckets of fibers waiting for events, by source and value (power of 2)
+#define WAITER_BUCKETS 64
+
 void *xmalloc(size_t sz) {
     auto r = malloc(sz);
     if (r == NULL)
@@ -52,23 +59,30 @@ FiberContext *currentFiber;
 static pthread_mutex_t eventMutex;
 static pthread_cond_t newEventBroadcast;
 
-static struct Event *eventHead, *eventTail;
-
 struct Event {
-    struct Event *next;
     int source;
     int value;
 };
 
-Event lastEvent;
+// keep in sync with core---linux/linux.cpp
+struct EventStats {
+    uint32_t numEvents;
+    // events dropped because the queue was full
+    uint32_t numOverflow;
+    // most events queued at once
+    uint32_t highWater;
+    uint32_t queueSize;
+};
 
-Event *mkEvent(int source, int value) {
-    auto res = new Event();
-    memset(res, 0, sizeof(Event));
-    res->source = source;
-    res->value = value;
-    return res;
-}
+// ring buffer written by raiseEvent() from any thread, read by wakeFibers();
+// eventHead and eventTail only grow, and are protected by eventMutex
+static Event eventQueue[EVENT_QUEUE_SIZE];
+static unsigned eventHead, eventTail;
+static EventStats eventStats;
+
+static FiberContext *waiters[WAITER_BUCKETS];
+
+Event lastEvent;
 
 volatile int panicCode;
 extern "C" void drawPanic(int code);
@@ -173,7 +187,18 @@ int current_time_ms() {
     return (int)(current_time_us() / 1000);
 }
 
+static FiberContext **waiterBucket(int source, int value);
+
 void disposeFiber(FiberContext *t) {
+    if (t->waitSource) {
+        for (auto p = waiterBucket(t->waitSource, t->waitValue); *p; p = &(*p)->nextWaiter) {
+            if (*p == t) {
+                *p = t->nextWaiter;
+                break;
+            }
+        }
+    }
+
     if (allFibers == t) {
         allFibers = t->next;
     } else {
@@ -236,9 +261,24 @@ void runForever(Action a) {
     f->foreverPC = f->resumePC;
 }
 
+static FiberContext **waiterBucket(int source, int value) {
+    // all DEVICE_ID_NOTIFY waiters share one queue, so that NOTIFY_ONE can find the one waiting
+    // longest, whether it waits for a specific value or for DEVICE_EVT_ANY
+    if (source == DEVICE_ID_NOTIFY)
+        value = DEVICE_EVT_ANY;
+    return &waiters[(source * 31 + value) & (WAITER_BUCKETS - 1)];
+}
+
 void waitForEvent(int source, int value) {
-    currentFiber->waitSource = source;
-    currentFiber->waitValue = value;
+    auto f = currentFiber;
+    f->waitSource = source;
+    f->waitValue = value;
+    // at the end, so that NOTIFY_ONE wakes up the fiber waiting longest
+    auto p = waiterBucket(source, value);
+    while (*p)
+        p = &(*p)->nextWaiter;
+    f->nextWaiter = NULL;
+    *p = f;
     schedule();
 }
 
@@ -254,34 +294,52 @@ static void dispatchEvent(Event &e) {
         setupThread(curr->action, fromInt(e.value));
 }
 
+// wake up fibers waiting for exactly this source and value
+static void wakeWaiters(int source, int value) {
+    auto p = waiterBucket(source, value);
+    while (*p) {
+        auto f = *p;
+        if (f->waitSource == source && f->waitValue == value) {
+            *p = f->nextWaiter;
+            f->nextWaiter = NULL;
+            f->waitSource = 0;
+        } else {
+            p = &f->nextWaiter;
+        }
+    }
+}
+
+// wake up the fiber waiting longest on DEVICE_ID_NOTIFY for this value or DEVICE_EVT_ANY
+static void wakeOneNotifyWaiter(int value) {
+    for (auto p = waiterBucket(DEVICE_ID_NOTIFY, value); *p; p = &(*p)->nextWaiter) {
+        auto f = *p;
+        if (f->waitSource == DEVICE_ID_NOTIFY &&
+            (f->waitValue == value || f->waitValue == DEVICE_EVT_ANY)) {
+            *p = f->nextWaiter;
+            f->nextWaiter = NULL;
+            f->waitSource = 0;
+            return;
+        }
+    }
+}
+
 static void wakeFibers() {
     for (;;) {
         pthread_mutex_lock(&eventMutex);
-        if (eventHead == NULL) {
+        if (eventHead == eventTail) {
             pthread_mutex_unlock(&eventMutex);
             return;
         }
-        Event *ev = eventHead;
-        eventHead = ev->next;
-        if (eventHead == NULL)
-            eventTail = NULL;
+        Event ev = eventQueue[eventHead++ & (EVENT_QUEUE_SIZE - 1)];
         pthread_mutex_unlock(&eventMutex);
 
-        for (auto thr = allFibers; thr; thr = thr->next) {
-            if (thr->waitSource == 0)
-                continue;
-            if (thr->waitValue != ev->value && thr->waitValue != DEVICE_EVT_ANY)
-                continue;
-            if (thr->waitSource == ev->source) {
-                thr->waitSource = 0;
-            } else if (thr->waitSource == DEVICE_ID_NOTIFY && ev->source == DEVICE_ID_NOTIFY_ONE) {
-                thr->waitSource = 0;
-                break; // do not wake up any other threads
-            }
-        }
+        wakeWaiters(ev.source, ev.value);
+        if (ev.value != DEVICE_EVT_ANY)
+            wakeWaiters(ev.source, DEVICE_EVT_ANY);
+        if (ev.source == DEVICE_ID_NOTIFY_ONE)
+            wakeOneNotifyWaiter(ev.value);
 
-        dispatchEvent(*ev);
-        delete ev;
+        dispatchEvent(ev);
     }
 }
 
@@ -291,6 +349,8 @@ static void mainRunLoop() {
         if (panicCode)
             return;
         wakeFibers();
+        // fibers are stopped here, so it's a good time for some GC work
+        gcIncrementalStep(PXT_GC_MARK_BUDGET_US);
         auto now = current_time_ms();
         auto fromBeg = false;
         if (!f) {
@@ -340,20 +400,30 @@ int allocateNotifyEvent() {
 }
 
 void raiseEvent(int id, int event) {
-    auto e = mkEvent(id, event);
     pthread_mutex_lock(&eventMutex);
-    if (eventTail == NULL) {
-        if (eventHead != NULL)
-            oops(51);
-        eventHead = eventTail = e;
+    unsigned len = eventTail - eventHead;
+    if (len >= EVENT_QUEUE_SIZE) {
+        eventStats.numOverflow++;
     } else {
-        eventTail->next = e;
-        eventTail = e;
+        auto e = &eventQueue[eventTail++ & (EVENT_QUEUE_SIZE - 1)];
+        e->source = id;
+        e->value = event;
+        eventStats.numEvents++;
+        if (len + 1 > eventStats.highWater)
+            eventStats.highWater = len + 1;
     }
     pthread_cond_broadcast(&newEventBroadcast);
     pthread_mutex_unlock(&eventMutex);
 }
 
+Buffer getEventStats() {
+    pthread_mutex_lock(&eventMutex);
+    auto stats = eventStats;
+    pthread_mutex_unlock(&eventMutex);
+    stats.queueSize = EVENT_QUEUE_SIZE;
+    return mkBuffer((uint8_t *)&stats, sizeof(stats));
+}
+
 DLLEXPORT void pxt_raise_event(int id, int event) {
     raiseEvent(id, event);
 }
@@ -430,6 +500,23 @@ void *gcAllocBlock(size_t sz) {
     return r;
 }
 
+int vmCaptureStack(uint32_t *dst, int max) {
+    auto f = currentFiber;
+    int n = 0;
+    if (!f || !f->pc)
+        return 0;
+    if (n < max)
+        dst[n++] = f->pc - f->imgbase;
+    // return addresses are stored as VM_ENCODE_PC() on the stack
+    auto end = f->stackBase + VM_STACK_SIZE - 1;
+    for (auto ptr = f->sp; ptr <= end && n < max; ptr++) {
+        auto v = *ptr;
+        if (!isDouble(v) && ((uintptr_t)v & 0x1ff) == 2 && v != TAG_STACK_BOTTOM)
+            dst[n++] = VM_DECODE_PC(v);
+    }
+    return n;
+}
+
 void gcProcessStacks(int flags) {
     int cnt = 0;
     for (auto f = allFibers; f; f = f->next) {
@@ -483,6 +570,7 @@ void systemReset() {
     while (allFibers) {
         disposeFiber(allFibers);
     }
+    memset(waiters, 0, sizeof(waiters));
 
     // this will consume all events, but won't dispatch anything, since all listener maps are empty
     wakeFibers();
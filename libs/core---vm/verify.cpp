@@ -365,7 +365,109 @@ static VMImage *loadIfaceNames(VMImage *img) {
 
 void validateFunction(VMImage *img, VMImageSection *sect, int debug);
 
+#ifdef VM_THREADED_DISPATCH
+#define FUSE_ANY 0xff // don't care about VM_THREADED_PUSH
+
+struct FuseStep {
+    ThreadedKind kind;
+    uint8_t flags;
+    const char *rtcall; // name of API function, for ThreadedKind::RtCall
+};
+
+struct FusePattern {
+    ThreadedKind fused;
+    uint8_t length;
+    FuseStep steps[3];
+};
+
+// Longer patterns first. Only the last step can have the push flag, unless it's
+// explicitly listed; the fused handler applies it.
+static const FusePattern fusePatterns[] = {
+    {ThreadedKind::LdlocLdintAdds,
+     3,
+     {{ThreadedKind::Ldloc, VM_THREADED_PUSH, NULL},
+      {ThreadedKind::Ldint, 0, NULL},
+      {ThreadedKind::RtCall, FUSE_ANY, "numops::adds"}}},
+    {ThreadedKind::LdlocLdintSubs,
+     3,
+     {{ThreadedKind::Ldloc, VM_THREADED_PUSH, NULL},
+      {ThreadedKind::Ldint, 0, NULL},
+      {ThreadedKind::RtCall, FUSE_ANY, "numops::subs"}}},
+    {ThreadedKind::LdlocJmpz, 2, {{ThreadedKind::Ldloc, 0, NULL}, {ThreadedKind::Jmpz, 0, NULL}}},
+    {ThreadedKind::LdlocJmpnz,
+     2,
+     {{ThreadedKind::Ldloc, 0, NULL}, {ThreadedKind::Jmpnz, 0, NULL}}},
+    {ThreadedKind::LdlocPushLdloc,
+     2,
+     {{ThreadedKind::Ldloc, VM_THREADED_PUSH, NULL}, {ThreadedKind::Ldloc, FUSE_ANY, NULL}}},
+    {ThreadedKind::LdlocPushLdint,
+     2,
+     {{ThreadedKind::Ldloc, VM_THREADED_PUSH, NULL}, {ThreadedKind::Ldint, FUSE_ANY, NULL}}},
+    {ThreadedKind::LdintStloc, 2, {{ThreadedKind::Ldint, 0, NULL}, {ThreadedKind::Stloc, 0, NULL}}},
+    {ThreadedKind::LdlocLdfld,
+     2,
+     {{ThreadedKind::Ldloc, 0, NULL}, {ThreadedKind::Ldfld, FUSE_ANY, NULL}}},
+    {ThreadedKind::LdfldLdfld,
+     2,
+     {{ThreadedKind::Ldfld, 0, NULL}, {ThreadedKind::Ldfld, FUSE_ANY, NULL}}},
+};
+
+static bool fuseStepMatches(VMImage *img, const VMThreadedOp *op, const FuseStep *step) {
+    if (op->label != threadedLabel(step->kind))
+        return false;
+    if (step->flags != FUSE_ANY && op->flags != step->flags)
+        return false;
+    if (step->rtcall) {
+        auto opd = img->opcodeDescs[op->opIdx];
+        if (!opd || strcmp(opd->name, step->rtcall) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Peephole pass over threaded code of a function. Only the label of the first
+// instruction of a sequence is replaced, so jumps into the middle of the sequence
+// still land on regular instructions.
+static void fuseFunction(VMImage *img, VMImageSection *sect) {
+    auto code = (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET);
+    auto lastPC = (sect->size - VM_FUNCTION_CODE_OFFSET) >> 1;
+    auto ops = img->threadedCode + (code - (uint16_t *)img->dataStart);
+    unsigned pc = 0;
+
+    while (pc < lastPC) {
+        auto op = &ops[pc];
+        unsigned len = op->len;
+
+        for (auto &pat : fusePatterns) {
+            unsigned p = pc;
+            unsigned i;
+            for (i = 0; i < pat.length; ++i) {
+                if (p >= lastPC || !fuseStepMatches(img, &ops[p], &pat.steps[i]))
+                    break;
+                p += ops[p].len;
+            }
+            if (i == pat.length) {
+                op->label = threadedLabel(pat.fused);
+                img->numFusedSites++;
+                len = p - pc;
+                break;
+            }
+        }
+
+        pc += len;
+    }
+}
+#endif
+
 static VMImage *validateFunctions(VMImage *img) {
+#ifdef VM_THREADED_DISPATCH
+    if (vmThreadedDispatch) {
+        // one entry per 16 bit word of the image; only function code is filled in
+        auto numWords = (img->dataEnd - img->dataStart) * 4;
+        img->threadedCode = (VMThreadedOp *)calloc(numWords, sizeof(VMThreadedOp));
+    }
+#endif
+
     FOR_SECTIONS() {
         if (sect->type == SectionType::VTable) {
             uint8_t *endp = sect->data + sect->size - 8;
@@ -431,11 +533,27 @@ static VMImage *validateFunctions(VMImage *img) {
                 validateFunction(img, sect, 1);
                 return img;
             }
+#ifdef VM_THREADED_DISPATCH
+            if (img->threadedCode) {
+                threadFunction(img, sect);
+                fuseFunction(img, sect);
+            }
+#endif
         }
     }
     return NULL;
 }
 
+static void allocInlineCaches(VMImage *img) {
+    // direct-mapped on call site; leave some room for collisions
+    uint32_t size = 16;
+    while (size < img->numIfaceCallSites * 2)
+        size <<= 1;
+    img->ifaceCache = (VMIfaceCache *)calloc(size, sizeof(VMIfaceCache));
+    img->mapCache = (VMMapCache *)calloc(size, sizeof(VMMapCache));
+    img->ifaceCacheMask = size - 1;
+}
+
 static VMImage *checkVTables(VMImage *img) {
     FOR_SECTIONS() {
         auto vt = vtFor(sect);
@@ -473,6 +591,13 @@ VMImage *loadVMImage(void *data, unsigned length) {
         return img;
     }
 
+    allocInlineCaches(img);
+
+#ifdef VM_THREADED_DISPATCH
+    if (img->threadedCode)
+        DMESG("threaded code: %d superinstruction sites", img->numFusedSites);
+#endif
+
     DMESG("image loaded");
 
     return img;
@@ -488,6 +613,9 @@ void unloadVMImage(VMImage *img) {
     free(img->opcodeDescs);
     free(img->numberLiterals);
     free(img->ifaceMemberNames);
+    free(img->threadedCode);
+    free(img->ifaceCache);
+    free(img->mapCache);
 
     free(img->dataStart);
     memset(img, 0, sizeof(*img));
@@ -126,6 +126,7 @@ void op_stfld(FiberContext *ctx, unsigned arg) {
     auto obj = POPVAL();
     checkClass(ctx, obj, classId, fldId);
     ((RefRecord *)obj)->fields[fldId] = ctx->r0;
+    gcWriteBarrier((RefObject *)obj, ctx->r0);
 }
 
 static RefAction *bindAction(FiberContext *ctx, RefAction *ra, TValue obj) {
@@ -272,7 +273,7 @@ void restoreVMExceptionState(TryFrame *tf, FiberContext *ctx) {
     longjmp(ctx->loopjmp, 1);
 }
 
-static TValue lookupIfaceMember(TValue obj, VTable *vt, unsigned ifaceIdx) {
+static IfaceEntry *findIfaceEntry(VTable *vt, unsigned ifaceIdx) {
     uint32_t mult = vt->ifaceHashMult;
     uint32_t off = (ifaceIdx * mult) >> (mult & 0xff);
 
@@ -281,18 +282,103 @@ static TValue lookupIfaceMember(TValue obj, VTable *vt, unsigned ifaceIdx) {
     while (n--) {
         uint32_t off2 = multBase[off];
         auto ent = (struct IfaceEntry *)multBase + off2;
+        if (ent->memberId == ifaceIdx)
+            return ent;
+        off++;
+    }
 
-        if (ent->memberId == ifaceIdx) {
-            if (ent->aux != 0) {
-                return vmImg->pointerLiterals[ent->method];
-            } else {
-                return ((RefRecord *)obj)->fields[ent->method - 1];
+    return NULL;
+}
+
+static TValue lookupIfaceMember(TValue obj, VTable *vt, unsigned ifaceIdx) {
+    auto ent = findIfaceEntry(vt, ifaceIdx);
+    if (!ent)
+        return NULL;
+    if (ent->aux != 0) {
+        return vmImg->pointerLiterals[ent->method];
+    } else {
+        return ((RefRecord *)obj)->fields[ent->method - 1];
+    }
+}
+
+// Polymorphic inline cache, keyed by the call site (ctx->pc, which points just past
+// the instruction) and the vtable. The member id is checked too, as op_mapget/op_mapset
+// pass a dynamic one.
+static IfaceEntry *cachedIfaceEntry(FiberContext *ctx, VTable *vt, unsigned ifaceIdx) {
+    auto img = ctx->img;
+    if (!img->ifaceCache)
+        return findIfaceEntry(vt, ifaceIdx);
+
+    uint32_t pcOff = (uint32_t)(ctx->pc - ctx->imgbase);
+    auto c = &img->ifaceCache[pcOff & img->ifaceCacheMask];
+    if (c->pcOffset == pcOff) {
+        for (unsigned i = 0; i < VM_IFACE_CACHE_WAYS; ++i) {
+            if (c->vtables[i] == vt && c->entries[i]->memberId == ifaceIdx) {
+                img->cacheStats.ifaceHits++;
+                return c->entries[i];
             }
         }
-        off++;
+    } else {
+        // another site, or the first call here
+        memset(c, 0, sizeof(*c));
+        c->pcOffset = pcOff;
     }
 
-    return NULL;
+    img->cacheStats.ifaceMisses++;
+    auto ent = findIfaceEntry(vt, ifaceIdx);
+    if (ent) {
+        auto i = c->nextWay++ % VM_IFACE_CACHE_WAYS;
+        c->vtables[i] = vt;
+        c->entries[i] = ent;
+    }
+    return ent;
+}
+
+// Inline cache for properties of RefMap objects: the slot where the key was found
+// the last time at this call site. It's only a hint, validated against the map.
+static int cachedMapIdx(FiberContext *ctx, RefMap *map, String key) {
+    auto img = ctx->img;
+    if (!img->mapCache)
+        return map->findIdx(key);
+
+    uint32_t pcOff = (uint32_t)(ctx->pc - ctx->imgbase);
+    auto c = &img->mapCache[pcOff & img->ifaceCacheMask];
+    if (c->pcOffset == pcOff && c->slot < map->keys.getLength()) {
+        auto k = (String)map->keys.get(c->slot);
+        if (k == key || (k->getUTF8Size() == key->getUTF8Size() &&
+                         memcmp(k->getUTF8Data(), key->getUTF8Data(), key->getUTF8Size()) == 0)) {
+            img->cacheStats.mapHits++;
+            return (int)c->slot;
+        }
+    }
+
+    img->cacheStats.mapMisses++;
+    int i = map->findIdx(key);
+    if (i >= 0) {
+        c->pcOffset = pcOff;
+        c->slot = i;
+    }
+    return i;
+}
+
+static TValue cachedMapGet(FiberContext *ctx, RefMap *map, String key) {
+    int i = cachedMapIdx(ctx, map, key);
+    if (i < 0)
+        return TAG_UNDEFINED;
+    return map->values.get(i);
+}
+
+static void cachedMapSet(FiberContext *ctx, RefMap *map, String key, TValue val) {
+    int i = cachedMapIdx(ctx, map, key);
+    if (i < 0)
+        pxtrt::mapSetByString(map, key, val); // new key
+    else
+        map->values.set(i, val);
+}
+
+static inline String ifaceMemberName(FiberContext *ctx, unsigned ifaceIdx) {
+    // the first entry is the length
+    return (String)ctx->img->ifaceMemberNames[ifaceIdx + 1];
 }
 
 /* skip .d.ts */ enum class CallType { Call = 0, Get = 1, Set = 2 };
@@ -307,11 +393,12 @@ static inline void callifaceCore(FiberContext *ctx, unsigned numArgs, unsigned i
 
     if (!mult) {
         if (vt->classNo == BuiltInType::RefMap) {
+            auto key = ifaceMemberName(ctx, ifaceIdx);
             if (getset == CallType::Set) {
-                pxtrt::mapSet((RefMap *)obj, ifaceIdx, ctx->sp[0]);
+                cachedMapSet(ctx, (RefMap *)obj, key, ctx->sp[0]);
                 POP(2); // and pop arguments
             } else {
-                ctx->r0 = pxtrt::mapGet((RefMap *)obj, ifaceIdx);
+                ctx->r0 = cachedMapGet(ctx, (RefMap *)obj, key);
                 if (getset == CallType::Call) {
                     shiftArg(ctx, numArgs);
                     op_callind(ctx, numArgs - 1);
@@ -323,50 +410,43 @@ static inline void callifaceCore(FiberContext *ctx, unsigned numArgs, unsigned i
         }
         missingProperty(obj);
     }
-    uint32_t off = (ifaceIdx * mult) >> (mult & 0xff);
 
-    unsigned n = 3;
-    auto multBase = (uint16_t *)&vt->methods[VM_NUM_CPP_METHODS];
-    while (n--) {
-        uint32_t off2 = multBase[off];
-        auto ent = (struct IfaceEntry *)multBase + off2;
-
-        if (ent->memberId == ifaceIdx) {
-            if (ent->aux != 0) {
-                if (getset == CallType::Set) {
-                    ent++;
-                    if (ent->memberId != ifaceIdx)
-                        missingProperty(obj);
-                }
-                auto fn = (RefAction *)ctx->img->pointerLiterals[ent->method];
-                if (getset == CallType::Get && ent->aux == 2) {
-                    ctx->r0 = (TValue)bindAction(ctx, fn, obj);
-                    POP(1);
-                    return;
-                }
-                callind(ctx, fn, numArgs);
+    auto ent = cachedIfaceEntry(ctx, vt, ifaceIdx);
+    if (ent) {
+        if (ent->aux != 0) {
+            if (getset == CallType::Set) {
+                ent++;
+                if (ent->memberId != ifaceIdx)
+                    missingProperty(obj);
+            }
+            auto fn = (RefAction *)ctx->img->pointerLiterals[ent->method];
+            if (getset == CallType::Get && ent->aux == 2) {
+                ctx->r0 = (TValue)bindAction(ctx, fn, obj);
+                POP(1);
+                return;
+            }
+            callind(ctx, fn, numArgs);
+        } else {
+            if (getset == CallType::Set) {
+                // store field
+                ((RefRecord *)obj)->fields[ent->method - 1] = ctx->sp[0];
+                gcWriteBarrier((RefObject *)obj, ctx->sp[0]);
+                POP(2); // and pop arguments
             } else {
-                if (getset == CallType::Set) {
-                    // store field
-                    ((RefRecord *)obj)->fields[ent->method - 1] = ctx->sp[0];
-                    POP(2); // and pop arguments
+                // load field
+                ctx->r0 = ((RefRecord *)obj)->fields[ent->method - 1];
+                if (getset == CallType::Call) {
+                    // and call
+                    shiftArg(ctx, numArgs);
+                    op_callind(ctx, numArgs - 1);
                 } else {
-                    // load field
-                    ctx->r0 = ((RefRecord *)obj)->fields[ent->method - 1];
-                    if (getset == CallType::Call) {
-                        // and call
-                        shiftArg(ctx, numArgs);
-                        op_callind(ctx, numArgs - 1);
-                    } else {
-                        // if just loading, pop the object arg
-                        POP(1);
-                    }
+                    // if just loading, pop the object arg
+                    POP(1);
                 }
             }
-
-            return;
         }
-        off++;
+
+        return;
     }
 
     if (getset == CallType::Get) {
@@ -401,7 +481,7 @@ void op_mapget(FiberContext *ctx, unsigned arg) {
     auto vt = getVTable((RefObject *)obj);
     auto key = numops::toString(ctx->r0);
     if (vt->classNo == BuiltInType::RefMap) {
-        ctx->r0 = pxtrt::mapGetByString((RefMap *)obj, key);
+        ctx->r0 = cachedMapGet(ctx, (RefMap *)obj, key);
         POP(1);
     } else {
         int k = pxtrt::lookupMapKey(key);
@@ -423,7 +503,7 @@ void op_mapset(FiberContext *ctx, unsigned arg) {
     auto key = numops::toString(ctx->sp[0]);
     ctx->sp[0] = (TValue)key; // save it, so it doesn't get GCed
     if (vt->classNo == BuiltInType::RefMap) {
-        pxtrt::mapSetByString((RefMap *)obj, key, ctx->r0);
+        cachedMapSet(ctx, (RefMap *)obj, key, ctx->r0);
         POP(2);
     } else {
         int k = pxtrt::lookupMapKey(key);
@@ -500,12 +580,7 @@ String convertToString(FiberContext *ctx, TValue v) {
     return rr;
 }
 
-void exec_loop(FiberContext *ctx) {
-    if (ctx->img->execLock) {
-        DMESG("image locked!");
-        target_panic(PANIC_VM_ERROR);
-    }
-    ctx->img->execLock = 1;
+static void exec_basic(FiberContext *ctx) {
     auto opcodes = ctx->img->opcodes;
     setjmp(ctx->loopjmp);
     while (ctx->pc) {
@@ -530,9 +605,281 @@ void exec_loop(FiberContext *ctx) {
                 PUSH(ctx->r0);
         }
     }
+}
+
+#ifdef VM_THREADED_DISPATCH
+// set with pxt_vm_set_threaded_dispatch(); only affects images loaded afterwards
+int vmThreadedDispatch = 1;
+
+static const void *const *threadedLabels;
+
+// The local pc is authoritative while running inline opcodes; ctx->pc is only
+// synced before calling out to opcode/API functions (which may jump, call, return,
+// throw or yield) and re-read after they return.
+// panicCode is only checked on jumps and calls - straight-line code always terminates.
+#define T_DISPATCH()                                                                               \
+    do {                                                                                           \
+        if (!pc)                                                                                   \
+            goto done;                                                                             \
+        ip = tbase + (pc - imgbase);                                                               \
+        TRACE("0x%x: T%d %d", (uint8_t *)pc - (uint8_t *)ctx->img->dataStart, ip->opIdx,          \
+              (int)(ctx->stackBase + VM_STACK_SIZE - ctx->sp));                                    \
+        goto *ip->label;                                                                           \
+    } while (0)
+#define T_PUSH()                                                                                   \
+    do {                                                                                           \
+        if (ip->flags & VM_THREADED_PUSH)                                                          \
+            PUSH(ctx->r0);                                                                         \
+    } while (0)
+#define T_NEXT()                                                                                   \
+    do {                                                                                           \
+        pc += ip->len;                                                                             \
+        T_PUSH();                                                                                  \
+        T_DISPATCH();                                                                              \
+    } while (0)
+#define T_LDFLD()                                                                                  \
+    do {                                                                                           \
+        unsigned fldId = ip->arg & 255, classId = ip->arg >> 8;                                    \
+        ctx->pc = pc + ip->len; /* checkClass() may throw */                                       \
+        checkClass(ctx, ctx->r0, classId, fldId);                                                  \
+        ctx->r0 = ((RefRecord *)ctx->r0)->fields[fldId];                                           \
+    } while (0)
+// continue with the next instruction of a superinstruction, skipping the dispatch
+#define T_CHAIN(lbl)                                                                               \
+    do {                                                                                           \
+        pc += ip->len;                                                                             \
+        ip += ip->len;                                                                             \
+        goto lbl;                                                                                  \
+    } while (0)
+// ldloc.push x; ldint n; adds/subs - ints that don't overflow never leave the loop
+#define T_LOCAL_INT_OP(op)                                                                         \
+    do {                                                                                           \
+        auto a = ctx->sp[ip->arg];                                                                 \
+        auto b = TAG_NUMBER((ip + ip->len)->arg);                                                  \
+        if (bothNumbers(a, b)) {                                                                   \
+            auto tmp = (int64_t)numValue(a) op(int64_t) numValue(b);                               \
+            if ((int)tmp == tmp) {                                                                 \
+                ctx->r0 = TAG_NUMBER((int)tmp);                                                    \
+                pc += ip->len;                                                                     \
+                ip += ip->len;                                                                     \
+                pc += ip->len;                                                                     \
+                ip += ip->len;                                                                     \
+                T_NEXT();                                                                          \
+            }                                                                                      \
+        }                                                                                          \
+        ctx->r0 = a;                                                                               \
+        PUSH(a);                                                                                   \
+        T_CHAIN(L_ldint);                                                                          \
+    } while (0)
+#define T_JUMP(cond)                                                                               \
+    do {                                                                                           \
+        pc += ip->len;                                                                             \
+        if (cond) {                                                                                \
+            pc += (int)ip->arg;                                                                    \
+            if (panicCode)                                                                         \
+                goto done;                                                                         \
+        }                                                                                          \
+        T_PUSH();                                                                                  \
+        T_DISPATCH();                                                                              \
+    } while (0)
+
+// called with NULL ctx to export the label table to threadFunction()
+static void exec_threaded(FiberContext *ctx) {
+    // keep in sync with enum ThreadedKind
+    static const void *const labels[] = {
+        &&L_invalid, &&L_generic, &&L_rtcall, &&L_ldloc, &&L_stloc,
+        &&L_ldcap, &&L_ldglb, &&L_stglb, &&L_ldlit, &&L_ldnumber,
+        &&L_ldint, &&L_ldintneg, &&L_ldspecial, &&L_push, &&L_pop,
+        &&L_popmany, &&L_pushmany, &&L_jmp, &&L_jmpz, &&L_jmpnz,
+        &&L_ldfld,
+        // superinstructions
+        &&L_ldloc_jmpz, &&L_ldloc_jmpnz, &&L_ldloc_push_ldloc, &&L_ldloc_push_ldint,
+        &&L_ldint_stloc, &&L_ldloc_ldfld, &&L_ldfld_ldfld, &&L_ldloc_ldint_adds,
+        &&L_ldloc_ldint_subs,
+    };
+
+    if (!ctx) {
+        threadedLabels = labels;
+        return;
+    }
+
+    auto opcodes = ctx->img->opcodes;
+    auto imgbase = ctx->imgbase;
+    auto tbase = ctx->img->threadedCode;
+    const VMThreadedOp *ip;
+    uint16_t *pc;
+
+    setjmp(ctx->loopjmp);
+    // after longjmp() the locals are stale; always restart from ctx
+    pc = ctx->pc;
+    if (panicCode)
+        goto done;
+    T_DISPATCH();
+
+L_generic:
+    ctx->pc = pc + ip->len;
+    opcodes[ip->opIdx](ctx, ip->arg);
+    goto after_call;
+
+L_rtcall:
+    ctx->pc = pc + ip->len;
+    ((ApiFun)(void *)opcodes[ip->opIdx])(ctx);
+
+after_call:
+    T_PUSH();
+    pc = ctx->pc;
+    if (panicCode)
+        goto done;
+    T_DISPATCH();
+
+L_ldloc:
+    ctx->r0 = ctx->sp[ip->arg];
+    T_NEXT();
+
+L_stloc:
+    ctx->sp[ip->arg] = ctx->r0;
+    T_NEXT();
+
+L_ldcap:
+    ctx->r0 = ctx->currAction->fields[ip->arg];
+    T_NEXT();
+
+L_ldglb:
+    ctx->r0 = globals[ip->arg];
+    T_NEXT();
+
+L_stglb:
+    globals[ip->arg] = ctx->r0;
+    T_NEXT();
+
+L_ldlit:
+    ctx->r0 = ctx->img->pointerLiterals[ip->arg];
+    T_NEXT();
+
+L_ldnumber:
+    ctx->r0 = ctx->img->numberLiterals[ip->arg];
+    T_NEXT();
+
+L_ldint:
+    ctx->r0 = TAG_NUMBER(ip->arg);
+    T_NEXT();
+
+L_ldintneg:
+    ctx->r0 = TAG_NUMBER(-(int)ip->arg);
+    T_NEXT();
+
+L_ldspecial:
+    ctx->r0 = (TValue)(uintptr_t)ip->arg;
+    T_NEXT();
+
+L_push:
+    PUSH(ctx->r0);
+    T_NEXT();
+
+L_pop:
+    ctx->r0 = POPVAL();
+    T_NEXT();
+
+L_popmany:
+    POP(ip->arg);
+    T_NEXT();
+
+L_pushmany:
+    for (unsigned i = 0; i < ip->arg; ++i)
+        PUSH(TAG_UNDEFINED);
+    T_NEXT();
+
+L_jmp:
+    T_JUMP(true);
+
+L_jmpz:
+    T_JUMP(!toBoolQuick(ctx->r0));
+
+L_jmpnz:
+    T_JUMP(toBoolQuick(ctx->r0));
+
+L_ldfld:
+    T_LDFLD();
+    T_NEXT();
+
+L_ldloc_jmpz:
+    ctx->r0 = ctx->sp[ip->arg];
+    T_CHAIN(L_jmpz);
+
+L_ldloc_jmpnz:
+    ctx->r0 = ctx->sp[ip->arg];
+    T_CHAIN(L_jmpnz);
+
+L_ldloc_push_ldloc:
+    ctx->r0 = ctx->sp[ip->arg];
+    PUSH(ctx->r0);
+    T_CHAIN(L_ldloc);
+
+L_ldloc_push_ldint:
+    ctx->r0 = ctx->sp[ip->arg];
+    PUSH(ctx->r0);
+    T_CHAIN(L_ldint);
+
+L_ldint_stloc:
+    ctx->r0 = TAG_NUMBER(ip->arg);
+    T_CHAIN(L_stloc);
+
+L_ldloc_ldfld:
+    ctx->r0 = ctx->sp[ip->arg];
+    T_CHAIN(L_ldfld);
+
+L_ldfld_ldfld:
+    T_LDFLD();
+    T_CHAIN(L_ldfld);
+
+L_ldloc_ldint_adds: {
+    T_LOCAL_INT_OP(+);
+}
+
+L_ldloc_ldint_subs: {
+    T_LOCAL_INT_OP(-);
+}
+
+L_invalid:
+    DMESG("invalid threaded op at 0x%x", (uint8_t *)pc - (uint8_t *)ctx->img->dataStart);
+    target_panic(PANIC_VM_ERROR);
+
+done:
+    ctx->pc = pc;
+}
+
+DLLEXPORT void pxt_vm_set_threaded_dispatch(int enabled) {
+    vmThreadedDispatch = enabled;
+}
+#endif
+
+void exec_loop(FiberContext *ctx) {
+    if (ctx->img->execLock) {
+        DMESG("image locked!");
+        target_panic(PANIC_VM_ERROR);
+    }
+    ctx->img->execLock = 1;
+#ifdef VM_THREADED_DISPATCH
+    if (ctx->img->threadedCode)
+        exec_threaded(ctx);
+    else
+#endif
+        exec_basic(ctx);
     ctx->img->execLock = 0;
 }
 
+// copies VMCacheStats of the running image into dst; returns number of words written
+DLLEXPORT int pxt_vm_get_cache_stats(uint32_t *dst, int maxWords) {
+    auto img = vmImg;
+    if (!img)
+        return 0;
+    int n = sizeof(VMCacheStats) / sizeof(uint32_t);
+    if (n > maxWords)
+        n = maxWords;
+    memcpy(dst, &img->cacheStats, n * sizeof(uint32_t));
+    return n;
+}
+
 } // namespace pxt
 
 //
@@ -566,7 +913,7 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
 
     RefAction *ra = (RefAction *)vmLiteralVal(sect);
 
-    if (ra->vtable != &pxt::RefAction_vtable)
+    if (getVTable(ra) != &pxt::RefAction_vtable)
         FNERR(1251);
     if ((uint8_t *)img->dataStart + ra->func != (uint8_t *)code)
         FNERR(1252);
@@ -654,12 +1001,16 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
             currStack--;
             if (currStack < baseStack)
                 FNERR(1245);
+            if (!debug)
+                img->numIfaceCallSites++; // for objects that are not RefMap
         } else if (fn == op_mapset) {
             if (arg)
                 FNERR(1246);
             currStack -= 2;
             if (currStack < baseStack)
                 FNERR(1247);
+            if (!debug)
+                img->numIfaceCallSites++; // for objects that are not RefMap
         } else if (fn == op_ret) {
             SPLIT_ARG(retNumArgs, numTmps);
             if (currStack != baseStack)
@@ -739,18 +1090,24 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
             currStack -= numArgs;
             if (currStack < baseStack)
                 FNERR(1230);
+            if (!debug)
+                img->numIfaceCallSites++;
         } else if (fn == op_callget) {
             if (arg == 0 || arg >= img->numIfaceMemberNames)
                 FNERR(1241);
             currStack -= 1;
             if (currStack < baseStack)
                 FNERR(1230);
+            if (!debug)
+                img->numIfaceCallSites++;
         } else if (fn == op_callset) {
             if (arg == 0 || arg >= img->numIfaceMemberNames)
                 FNERR(1242);
             currStack -= 2;
             if (currStack < baseStack)
                 FNERR(1230);
+            if (!debug)
+                img->numIfaceCallSites++;
         } else if (fn == op_ldspecial) {
             auto a = (TValue)(uintptr_t)arg;
             if (a != TAG_TRUE && a != TAG_FALSE && a != TAG_UNDEFINED && a != TAG_NULL &&
@@ -795,4 +1152,103 @@ void validateFunction(VMImage *img, VMImageSection *sect, int debug) {
     }
 }
 
-} // namespace pxt
\ No newline at end of file
+#ifdef VM_THREADED_DISPATCH
+static ThreadedKind threadedKindOf(OpFun fn) {
+    if (fn == op_ldloc)
+        return ThreadedKind::Ldloc;
+    if (fn == op_stloc)
+        return ThreadedKind::Stloc;
+    if (fn == op_ldcap)
+        return ThreadedKind::Ldcap;
+    if (fn == op_ldglb)
+        return ThreadedKind::Ldglb;
+    if (fn == op_stglb)
+        return ThreadedKind::Stglb;
+    if (fn == op_ldlit)
+        return ThreadedKind::Ldlit;
+    if (fn == op_ldnumber)
+        return ThreadedKind::Ldnumber;
+    if (fn == op_ldint)
+        return ThreadedKind::Ldint;
+    if (fn == op_ldintneg)
+        return ThreadedKind::Ldintneg;
+    if (fn == op_ldspecial)
+        return ThreadedKind::Ldspecial;
+    if (fn == op_push)
+        return ThreadedKind::Push;
+    if (fn == op_pop)
+        return ThreadedKind::Pop;
+    if (fn == op_popmany)
+        return ThreadedKind::Popmany;
+    if (fn == op_pushmany)
+        return ThreadedKind::Pushmany;
+    if (fn == op_jmp)
+        return ThreadedKind::Jmp;
+    if (fn == op_jmpz)
+        return ThreadedKind::Jmpz;
+    if (fn == op_jmpnz)
+        return ThreadedKind::Jmpnz;
+    if (fn == op_ldfld)
+        return ThreadedKind::Ldfld;
+    return ThreadedKind::Generic;
+}
+
+const void *threadedLabel(ThreadedKind kind) {
+    if (!threadedLabels)
+        exec_threaded(NULL);
+    return threadedLabels[(int)kind];
+}
+
+// Pre-decode an (already validated) function into img->threadedCode.
+void threadFunction(VMImage *img, VMImageSection *sect) {
+    if (!threadedLabels)
+        exec_threaded(NULL);
+
+    auto code = (uint16_t *)((uint8_t *)sect + VM_FUNCTION_CODE_OFFSET);
+    auto lastPC = (sect->size - VM_FUNCTION_CODE_OFFSET) >> 1;
+    auto dst = img->threadedCode + (code - (uint16_t *)img->dataStart);
+    unsigned pc = 0;
+
+    while (pc < lastPC) {
+        auto op = &dst[pc];
+        uint16_t opcode = code[pc++];
+        ThreadedKind kind;
+
+        op->len = 1;
+        op->flags = 0;
+
+        if (opcode >> 15 == 0) {
+            op->opIdx = opcode & VM_OPCODE_BASE_MASK;
+            op->arg = opcode >> VM_OPCODE_ARG_POS;
+            if (opcode & VM_OPCODE_PUSH_MASK)
+                op->flags |= VM_THREADED_PUSH;
+            kind = threadedKindOf(img->opcodes[op->opIdx]);
+        } else if (opcode >> 14 == 0b10) {
+            op->opIdx = opcode & 0x1fff;
+            op->arg = 0;
+            if (opcode & VM_RTCALL_PUSH_MASK)
+                op->flags |= VM_THREADED_PUSH;
+            kind = ThreadedKind::RtCall;
+        } else {
+            unsigned tmp = ((int32_t)opcode << (16 + 2)) >> (2 + VM_OPCODE_ARG_POS);
+            // the second word is never a jump target
+            dst[pc].label = threadedLabels[(int)ThreadedKind::Invalid];
+            opcode = code[pc++];
+            op->len = 2;
+            op->opIdx = opcode & VM_OPCODE_BASE_MASK;
+            op->arg = (opcode >> VM_OPCODE_ARG_POS) + tmp;
+            if (opcode & VM_OPCODE_PUSH_MASK)
+                op->flags |= VM_THREADED_PUSH;
+            kind = threadedKindOf(img->opcodes[op->opIdx]);
+        }
+
+        // padding at the end decodes as opcode 0, which may not exist
+        if (kind != ThreadedKind::RtCall && !img->opcodes[op->opIdx])
+            kind = ThreadedKind::Invalid;
+
+        op->label = threadedLabels[(int)kind];
+    }
+}
+#endif
+
+} // namespace pxt
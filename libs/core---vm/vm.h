@@ -23,6 +23,11 @@
 #define VM_NUM_CPP_METHODS 4
 #endif
 
+// computed-goto dispatch needs GCC/clang "labels as values"
+#if defined(__GNUC__) && !defined(PXT_VM_NO_THREADED)
+#define VM_THREADED_DISPATCH 1
+#endif
+
 // maximum size (in words) of stack in a single function
 #define VM_MAX_FUNCTION_STACK 200
 #define VM_STACK_SIZE 1000
@@ -103,6 +108,43 @@ struct IfaceEntry {
 
 extern const OpcodeDesc staticOpcodes[];
 
+#define VM_THREADED_PUSH 0x01
+
+// Pre-decoded instruction, as executed by the threaded interpreter.
+// There is one of these for every 16 bit word of the image, so that
+// VMImage::threadedCode[pc - imgbase] describes the instruction at pc.
+struct VMThreadedOp {
+    const void *label; // computed-goto target
+    uint32_t arg;
+    uint16_t opIdx;
+    uint8_t flags;
+    uint8_t len; // in 16 bit words
+};
+
+#define VM_IFACE_CACHE_WAYS 4
+
+// inline cache for op_calliface/op_callget/op_callset
+struct VMIfaceCache {
+    uint32_t pcOffset; // call site, in 16 bit words from imgbase; 0 if unused
+    uint32_t nextWay;  // round-robin replacement
+    VTable *vtables[VM_IFACE_CACHE_WAYS];
+    IfaceEntry *entries[VM_IFACE_CACHE_WAYS];
+};
+
+// inline cache for properties of RefMap objects
+struct VMMapCache {
+    uint32_t pcOffset; // call site, in 16 bit words from imgbase; 0 if unused
+    uint32_t slot;     // index into RefMap::keys where the key was last found
+};
+
+// keep in sync with pxt_vm_get_cache_stats() users
+struct VMCacheStats {
+    uint32_t ifaceHits;
+    uint32_t ifaceMisses;
+    uint32_t mapHits;
+    uint32_t mapMisses;
+};
+
 struct VMImageHeader {
     uint64_t magic0;
     uint64_t magic1;
@@ -133,6 +175,9 @@ struct VMImage {
     VMImageHeader *infoHeader;
     const OpcodeDesc **opcodeDescs;
     RefAction *entryPoint;
+    VMThreadedOp *threadedCode; // NULL when using the basic interpreter loop
+    VMIfaceCache *ifaceCache;
+    VMMapCache *mapCache; // same size as ifaceCache
 
     uint32_t numSections;
     uint32_t numNumberLiterals;
@@ -142,6 +187,10 @@ struct VMImage {
     uint32_t errorCode;
     uint32_t errorOffset;
     int toStringKey;
+    uint32_t numFusedSites;
+    uint32_t numIfaceCallSites;
+    uint32_t ifaceCacheMask;
+    VMCacheStats cacheStats;
 
     int execLock;
 };
@@ -176,6 +225,8 @@ struct FiberContext {
     // wait_for_event
     int waitSource;
     int waitValue;
+    // next fiber in the same waiters[] bucket
+    FiberContext *nextWaiter;
 
     // for sleep
     uint64_t wakeTime;
@@ -199,6 +250,47 @@ VMImage *loadVMImage(void *data, unsigned length);
 void unloadVMImage(VMImage *img);
 VMImage *setVMImgError(VMImage *img, int code, void *pos);
 void exec_loop(FiberContext *ctx);
+#ifdef VM_THREADED_DISPATCH
+// keep in sync with labels[] in exec_threaded()
+enum class ThreadedKind : uint8_t {
+    Invalid,
+    Generic,
+    RtCall,
+    Ldloc,
+    Stloc,
+    Ldcap,
+    Ldglb,
+    Stglb,
+    Ldlit,
+    Ldnumber,
+    Ldint,
+    Ldintneg,
+    Ldspecial,
+    Push,
+    Pop,
+    Popmany,
+    Pushmany,
+    Jmp,
+    Jmpz,
+    Jmpnz,
+    Ldfld,
+
+    // superinstructions; see fuseFunction() in verify.cpp
+    LdlocJmpz,
+    LdlocJmpnz,
+    LdlocPushLdloc,
+    LdlocPushLdint,
+    LdintStloc,
+    LdlocLdfld,
+    LdfldLdfld,
+    LdlocLdintAdds,
+    LdlocLdintSubs,
+};
+
+void threadFunction(VMImage *img, VMImageSection *sect);
+const void *threadedLabel(ThreadedKind kind);
+extern int vmThreadedDispatch;
+#endif
 void vmStartFromUser(const char *fn);
 void target_yield();
 
@@ -166,6 +166,10 @@ namespace tiles {
             this.data.setUint8(TM_DATA_PREFIX_LENGTH + (col | 0) + (row | 0) * this.width, tile);
         }
 
+        getTileData() {
+            return this.data;
+        }
+
         getTileset() {
             return this.tileset;
         }
@@ -359,7 +363,11 @@ namespace tiles {
             const y0 = Math.max(0, camera.drawOffsetY >> this.scale);
             const yn = Math.min(this._map.height, ((camera.drawOffsetY + target.height) >> this.scale) + 1);
 
-            for (let x = x0; x <= xn; ++x) {
+            const drawn = helpers.imageDrawTileMap(target, this._map.getTileData(),
+                this._map.getTileset(), this.scale, camera.drawOffsetX, camera.drawOffsetY);
+
+            // getTileImage() crops tiles to the cell, which imageDrawTileMap() does too
+            for (let x = x0; !drawn && x <= xn; ++x) {
                 for (let y = y0; y <= yn; ++y) {
                     const index = this._map.getTile(x, y);
                     const tile = this._map.getTileImage(index);
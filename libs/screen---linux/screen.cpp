@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <strings.h>
 #include <fcntl.h>
 #include <linux/fb.h>
 #include <linux/kd.h>
@@ -11,26 +12,126 @@
 #include <sys/ioctl.h>
 #include <pthread.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// screenBuf is converted in tiles of this many columns and rows, so that both the (column-major)
+// source and the (row-major) destination of a tile stay in cache
+#define TILE_W 32
+#define TILE_H 32
+
 namespace pxt {
+
+// framebuffer pixels for both nibbles (rows) of a screenBuf byte
+struct PixelPair {
+    uint32_t even, odd;
+};
+
+template <typename T> static inline T *fillPixels(T *d, uint32_t c, int n) {
+    while (n--)
+        *d++ = c;
+    return d;
+}
+
+static inline uint32_t *fillPixels(uint32_t *d, uint32_t c, int n) {
+#if defined(__SSE2__)
+    auto v = _mm_set1_epi32(c);
+    for (; n >= 4; n -= 4, d += 4)
+        _mm_storeu_si128((__m128i *)d, v);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    auto v = vdupq_n_u32(c);
+    for (; n >= 4; n -= 4, d += 4)
+        vst1q_u32(d, v);
+#endif
+    while (n--)
+        *d++ = c;
+    return d;
+}
+
+// convert n columns of a pair of rows, each source pixel repeated REP (or rep, if REP is 0) times
+template <typename T, int REP>
+static void convertRows(T *dA, T *dB, const uint8_t *src, int colBytes, int n,
+                        const PixelPair *lut, int rep) {
+    while (n--) {
+        auto &p = lut[*src];
+        src += colBytes;
+        if (REP == 0) {
+            dA = fillPixels(dA, p.even, rep);
+            dB = fillPixels(dB, p.odd, rep);
+        } else {
+            for (int j = 0; j < REP; ++j) {
+                dA[j] = p.even;
+                dB[j] = p.odd;
+            }
+            dA += REP;
+            dB += REP;
+        }
+    }
+}
+
+// keep in sync with screen---linux/targetoverrides.ts, function screenStats()
+struct ScreenStats {
+    // frames shown
+    uint32_t numFrames;
+    // frames replaced by a newer one before they were shown
+    uint32_t numDropped;
+    // time spent converting the last frame to the framebuffer
+    uint32_t lastConvertUs;
+    uint32_t maxConvertUs;
+    // time the display thread waited for the last frame
+    uint32_t lastWaitUs;
+    // time between the last two frames shown
+    uint32_t lastFrameUs;
+    uint32_t targetFps;
+    // time between the last two update() calls, i.e., rendering of a frame by the program
+    uint32_t lastRenderUs;
+};
+
 class WDisplay {
   public:
     uint32_t currPalette[16];
     bool newPalette;
-    volatile bool painted;
-    volatile bool dirty;
-
+    // incremented by setPalette(); pairPalette is rebuilt when it changes
+    volatile uint32_t paletteNo;
+    PixelPair pairPalette[256];
+
+    // triple buffering: update() fills frames[backBuf] and swaps it with frames[readyBuf];
+    // the display thread swaps frames[readyBuf] with frames[frontBuf] and shows that
+    uint8_t *frames[3];
+    int backBuf, readyBuf, frontBuf;
+    bool frameReady;
+    pthread_cond_t frameCond;
+    // signalled when the display thread takes the ready frame
+    pthread_cond_t frameTaken;
+
+    // the frame being shown, frames[frontBuf]
     uint8_t *screenBuf;
     Image_ lastImg;
+    // area of screenBuf not yet painted on given framebuffer page
+    int16_t pendX0[2], pendY0[2], pendX1[2], pendY1[2];
 
     int width, height;
+    // bytes per column of screenBuf, same as in the screen image
+    int colBytes;
+    int targetFps;
+
+    ScreenStats stats;
+    uint64_t lastUpdate;
+
+    // no /dev/fb0; fbuf is in memory (or a mapped file) and frames can be captured to a file
+    bool headless;
+    FILE *captureFile;
+    bool captureY4M;
+    uint8_t *captureBuf;
 
     int fb_fd;
     uint32_t *fbuf;
     struct fb_fix_screeninfo finfo;
     struct fb_var_screeninfo vinfo;
 
-    int eventId;
-
     int is32Bit;
 
     pthread_mutex_t mutex;
@@ -38,6 +139,13 @@ class WDisplay {
     WDisplay();
     void updateLoop();
     void update(Image_ img);
+    void addPending(int x, int y, int w, int h);
+    void initFramebuffer();
+    void initHeadless();
+    void initCapture(const char *fn);
+    void captureFrame();
+    template <typename T>
+    void paint(T *dst, int stride, int rep, int sy, int rx0, int ry0, int rx1, int ry1);
 };
 
 SINGLETON(WDisplay);
@@ -47,9 +155,64 @@ static void *updateDisplay(void *wd) {
     return NULL;
 }
 
+// Paint the rectangle of screenBuf to dst (the top-left screen pixel in the framebuffer), where
+// every pixel is repeated rep times horizontally and sy times vertically; stride is in units of T.
+template <typename T>
+void WDisplay::paint(T *dst, int stride, int rep, int sy, int rx0, int ry0, int rx1, int ry1) {
+    // a byte of screenBuf holds two rows, so paint whole pairs of rows
+    int ryEnd = ry1;
+    ry0 &= ~1;
+    ry1 = min(height & ~1, (ry1 + 1) & ~1);
+    int rowLen = rep * sizeof(T);
+
+    for (int ty = ry0; ty < ry1; ty += TILE_H) {
+        int tyEnd = min(ty + TILE_H, ry1);
+        for (int tx = rx0; tx < rx1; tx += TILE_W) {
+            int n = min(TILE_W, rx1 - tx);
+            for (int y = ty; y < tyEnd; y += 2) {
+                auto src = screenBuf + tx * colBytes + (y >> 1);
+                auto dA = dst + y * sy * stride + tx * rep;
+                auto dB = dA + sy * stride;
+                switch (rep) {
+                case 1:
+                    convertRows<T, 1>(dA, dB, src, colBytes, n, pairPalette, rep);
+                    break;
+                case 2:
+                    convertRows<T, 2>(dA, dB, src, colBytes, n, pairPalette, rep);
+                    break;
+                case 4:
+                    convertRows<T, 4>(dA, dB, src, colBytes, n, pairPalette, rep);
+                    break;
+                default:
+                    convertRows<T, 0>(dA, dB, src, colBytes, n, pairPalette, rep);
+                    break;
+                }
+                for (int i = 1; i < sy; ++i) {
+                    memcpy(dA + i * stride, dA, n * rowLen);
+                    memcpy(dB + i * stride, dB, n * rowLen);
+                }
+            }
+        }
+    }
+
+    // the last row of an odd-height screen has no pair
+    if (ryEnd > ry1) {
+        auto src = screenBuf + rx0 * colBytes + (ry1 >> 1);
+        auto d = dst + ry1 * sy * stride + rx0 * rep;
+        auto d0 = d;
+        for (int x = rx0; x < rx1; ++x) {
+            d = fillPixels(d, pairPalette[*src].even, rep);
+            src += colBytes;
+        }
+        for (int i = 1; i < sy; ++i)
+            memcpy(d0 + i * stride, d0, (rx1 - rx0) * rowLen);
+    }
+}
+
 void WDisplay::updateLoop() {
     int cur_page = 1;
     int frameNo = 0;
+    uint32_t lutPaletteNo = paletteNo - 1;
     int numPages = vinfo.yres_virtual / vinfo.yres;
     int ledScreen = getConfigInt("LED_SCREEN", 0);
 
@@ -76,7 +239,6 @@ void WDisplay::updateLoop() {
     }
 
     int screensize = finfo.line_length * vinfo.yres;
-    uint32_t skip = offx;
 
     if (sx > 1)
         offx &= ~1;
@@ -88,95 +250,90 @@ void WDisplay::updateLoop() {
     if (numPages == 1)
         cur_page = 0;
 
-    dirty = true;
+    uint32_t frameUs = 1000000 / targetFps;
+    uint64_t nextFrame = current_time_us();
+    uint64_t lastFrame = 0;
 
     DMESG("loop");
 
     for (;;) {
-        auto start0 = current_time_us();
+        auto waitStart = current_time_us();
+
+        pthread_mutex_lock(&mutex);
+        while (!frameReady)
+            pthread_cond_wait(&frameCond, &mutex);
+        frameReady = false;
+        swap(frontBuf, readyBuf);
+        screenBuf = frames[frontBuf];
+        pthread_cond_signal(&frameTaken);
+
+        // only repaint what changed since this page was last shown
+        int page = numPages > 1 ? cur_page : 0;
+        int rx0 = pendX0[page], ry0 = pendY0[page], rx1 = pendX1[page], ry1 = pendY1[page];
+        pendX0[page] = pendY0[page] = pendX1[page] = pendY1[page] = 0;
+        if (rx0 >= rx1 || ry0 >= ry1)
+            rx0 = rx1 = ry0 = ry1 = 0;
+        pthread_mutex_unlock(&mutex);
 
-        while (!dirty)
-            sleep_core_us(2000);
+        auto start = current_time_us();
 
-        // auto start = current_time_us();
-        // DMESG("update");
+        if (lutPaletteNo != paletteNo) {
+            lutPaletteNo = paletteNo;
+            for (int i = 0; i < 256; ++i) {
+                pairPalette[i].even = currPalette[i & 0xf];
+                pairPalette[i].odd = currPalette[i >> 4];
+            }
+        }
 
-        pthread_mutex_lock(&mutex);
-        dirty = false;
-
-        if (!is32Bit) {
-            uint16_t *dst =
-                (uint16_t *)fbuf + cur_page * screensize / 2 + offx + offy * finfo.line_length / 2;
-            if (sx == 1 && sy == 1) {
-                skip = vinfo.xres - width * sx;
-                for (int yy = 0; yy < height; yy++) {
-                    auto shift = yy & 1 ? 4 : 0;
-                    auto src = screenBuf + yy / 2;
-                    for (int xx = 0; xx < width; ++xx) {
-                        int c = this->currPalette[(*src >> shift) & 0xf];
-                        src += height / 2;
-                        *dst++ = c;
-                    }
-                    dst += skip;
-                }
+        if (rx0 < rx1) {
+            if (!is32Bit) {
+                uint16_t *dst = (uint16_t *)fbuf + cur_page * screensize / 2 + offx +
+                                offy * finfo.line_length / 2;
+                if (sx == 1 && sy == 1)
+                    paint(dst, finfo.line_length / 2, 1, 1, rx0, ry0, rx1, ry1);
+                else
+                    // sx is even here, and the palette has each color twice in a word
+                    paint((uint32_t *)dst, finfo.line_length / 4, sx / 2, sy, rx0, ry0, rx1,
+                          ry1);
             } else {
-                uint32_t *d2 = (uint32_t *)dst;
-                for (int yy = 0; yy < height; yy++) {
-                    auto shift = yy & 1 ? 4 : 0;
-                    for (int i = 0; i < sy; ++i) {
-                        auto src = screenBuf + yy / 2;
-                        for (int xx = 0; xx < width; ++xx) {
-                            int c = this->currPalette[(*src >> shift) & 0xf];
-                            src += height / 2;
-                            for (int j = 0; j < sx / 2; ++j)
-                                *d2++ = c;
-                        }
-                        d2 += skip;
-                    }
-                }
-            }
-        } else {
-            uint32_t *d2 =
-                (uint32_t *)fbuf + cur_page * screensize / 4 + offx + offy * finfo.line_length / 4;
-            skip = vinfo.xres - width * sx;
-            for (int yy = 0; yy < height; yy++) {
-                auto shift = yy & 1 ? 4 : 0;
-                for (int i = 0; i < sy; ++i) {
-                    auto src = screenBuf + yy / 2;
-                    for (int xx = 0; xx < width; ++xx) {
-                        int c = this->currPalette[(*src >> shift) & 0xf];
-                        src += height / 2;
-                        for (int j = 0; j < sx; ++j)
-                            *d2++ = c;
-                    }
-                    d2 += skip;
-                }
+                uint32_t *dst = (uint32_t *)fbuf + cur_page * screensize / 4 + offx +
+                                offy * finfo.line_length / 4;
+                paint(dst, finfo.line_length / 4, sx, sy, rx0, ry0, rx1, ry1);
             }
         }
 
-        pthread_mutex_unlock(&mutex);
-
-        // auto len = current_time_us() - start;
+        auto len = current_time_us() - start;
 
-        painted = true;
-        raiseEvent(DEVICE_ID_NOTIFY_ONE, eventId);
+        if (captureFile)
+            captureFrame();
 
-        vinfo.yoffset = cur_page * vinfo.yres;
-        ioctl(fb_fd, FBIOPAN_DISPLAY, &vinfo);
-        ioctl(fb_fd, FBIO_WAITFORVSYNC, 0);
+        if (!headless) {
+            vinfo.yoffset = cur_page * vinfo.yres;
+            ioctl(fb_fd, FBIOPAN_DISPLAY, &vinfo);
+            ioctl(fb_fd, FBIO_WAITFORVSYNC, 0);
+        }
         if (numPages > 1)
             cur_page = !cur_page;
         frameNo++;
 
-        auto fulllen = current_time_us() - start0;
-        // throttle it to 40fps (really 30fps)
-        if (fulllen < 25000) {
-            ioctl(fb_fd, FBIO_WAITFORVSYNC, 0);
-        }
-
-        // auto tot = current_time_us() - start;
-        // if (frameNo % 37 == 0)
-        //    DMESG("copy %d us, tot %d us delay %d us",  (int)len, (int)tot, (int)(start-start0));
+        // getScreenStats() reads these from the main thread
+        pthread_mutex_lock(&mutex);
+        stats.lastConvertUs = len;
+        stats.maxConvertUs = max(stats.maxConvertUs, (uint32_t)len);
+        stats.lastWaitUs = start - waitStart;
+        if (lastFrame)
+            stats.lastFrameUs = start - lastFrame;
+        stats.numFrames = frameNo;
+        pthread_mutex_unlock(&mutex);
+        lastFrame = start;
+
+        // don't show frames more often than targetFps; frames coming in faster get dropped
+        auto now = current_time_us();
+        nextFrame += frameUs;
+        if (now < nextFrame)
+            sleep_core_us(nextFrame - now);
+        else
+            nextFrame = now;
     }
 }
 
@@ -185,14 +342,48 @@ WDisplay::WDisplay() {
 
     width = getConfig(CFG_DISPLAY_WIDTH, 160);
     height = getConfig(CFG_DISPLAY_HEIGHT, 128);
-    screenBuf = new uint8_t[width * height / 2 + 20];
+    colBytes = ((height * 4 + 31) >> 5) << 2;
+    for (int i = 0; i < 3; ++i)
+        frames[i] = new uint8_t[width * colBytes];
+    backBuf = 0;
+    readyBuf = 1;
+    frontBuf = 2;
+    frameReady = false;
+    pthread_cond_init(&frameCond, NULL);
+    pthread_cond_init(&frameTaken, NULL);
+    screenBuf = frames[frontBuf];
     lastImg = NULL;
+    memset(&stats, 0, sizeof(stats));
+    lastUpdate = 0;
+    targetFps = getConfigInt("SCREEN_FPS", 40);
+    if (targetFps < 1)
+        targetFps = 1;
+    stats.targetFps = targetFps;
+    for (int i = 0; i < 2; ++i)
+        pendX0[i] = pendY0[i] = pendX1[i] = pendY1[i] = 0;
     newPalette = false;
+    paletteNo = 0;
 
     registerGC((TValue *)&lastImg);
 
-    eventId = allocateNotifyEvent();
+    headless = getConfigInt("SCREEN_HEADLESS", 0) != 0;
+    if (headless)
+        initHeadless();
+    else
+        initFramebuffer();
+
+    captureFile = NULL;
+    captureBuf = NULL;
+    auto fn = getConfigString("SCREEN_CAPTURE");
+    if (fn && *fn)
+        initCapture(fn);
+
+    pthread_t upd;
+    pthread_create(&upd, NULL, updateDisplay, this);
+    pthread_detach(upd);
+}
 
+void WDisplay::initFramebuffer() {
     int tty_fd = open("/dev/tty0", O_RDWR);
     ioctl(tty_fd, KDSETMODE, KD_GRAPHICS);
 
@@ -227,9 +418,101 @@ WDisplay::WDisplay() {
     fbuf = (uint32_t *)mmap(0, finfo.line_length * vinfo.yres_virtual, PROT_READ | PROT_WRITE,
                             MAP_SHARED, fb_fd, (off_t)0);
 
-    pthread_t upd;
-    pthread_create(&upd, NULL, updateDisplay, this);
-    pthread_detach(upd);
+}
+
+void WDisplay::initHeadless() {
+    int scale = max(1, getConfigInt("SCREEN_SCALE", 1));
+
+    memset(&finfo, 0, sizeof(finfo));
+    memset(&vinfo, 0, sizeof(vinfo));
+    vinfo.xres = vinfo.xres_virtual = width * scale;
+    vinfo.yres = vinfo.yres_virtual = height * scale;
+    vinfo.bits_per_pixel = 32;
+    finfo.line_length = vinfo.xres * 4;
+    is32Bit = true;
+
+    // optionally in a file (eg. in /dev/shm), so that other processes can look at the screen
+    auto size = finfo.line_length * vinfo.yres_virtual;
+    auto fn = getConfigString("SCREEN_FB_FILE");
+    if (fn && *fn) {
+        fb_fd = open(fn, O_RDWR | O_CREAT, 0644);
+        if (fb_fd < 0 || ftruncate(fb_fd, size) != 0)
+            target_panic(PANIC_SCREEN_ERROR);
+        fbuf = (uint32_t *)mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fb_fd, (off_t)0);
+        if (fbuf == MAP_FAILED)
+            target_panic(PANIC_SCREEN_ERROR);
+    } else {
+        fb_fd = -1;
+        fbuf = (uint32_t *)malloc(size);
+    }
+
+    DMESG("headless FB at %dx%d file=%s", vinfo.xres, vinfo.yres, fn ? fn : "-");
+}
+
+// Frames are written at screen resolution, as Y4M (4:4:4) if the file name ends with .y4m,
+// and as raw RGB24 otherwise.
+void WDisplay::initCapture(const char *fn) {
+    captureFile = fopen(fn, "wb");
+    if (!captureFile) {
+        DMESG("can't open capture file %s", fn);
+        return;
+    }
+    auto len = strlen(fn);
+    captureY4M = len >= 4 && strcasecmp(fn + len - 4, ".y4m") == 0;
+    captureBuf = new uint8_t[width * height * 3];
+    if (captureY4M)
+        fprintf(captureFile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height,
+                targetFps);
+    DMESG("capture to %s", fn);
+}
+
+void WDisplay::captureFrame() {
+    // RGB or YCbCr (BT.601) of each palette entry
+    uint8_t pal[16][3];
+    for (int i = 0; i < 16; ++i) {
+        int c = currPalette[i];
+        int r, g, b;
+        if (is32Bit) {
+            r = (c >> 16) & 0xff;
+            g = (c >> 8) & 0xff;
+            b = c & 0xff;
+        } else {
+            r = ((c >> 11) & 0x1f) << 3;
+            g = ((c >> 5) & 0x3f) << 2;
+            b = (c & 0x1f) << 3;
+        }
+        if (captureY4M) {
+            pal[i][0] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+            pal[i][1] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            pal[i][2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        } else {
+            pal[i][0] = r;
+            pal[i][1] = g;
+            pal[i][2] = b;
+        }
+    }
+
+    int plane = width * height;
+    for (int x = 0; x < width; ++x) {
+        auto src = screenBuf + x * colBytes;
+        for (int y = 0; y < height; ++y) {
+            auto c = pal[(src[y >> 1] >> ((y & 1) << 2)) & 0xf];
+            int i = y * width + x;
+            if (captureY4M) {
+                captureBuf[i] = c[0];
+                captureBuf[i + plane] = c[1];
+                captureBuf[i + 2 * plane] = c[2];
+            } else {
+                memcpy(captureBuf + i * 3, c, 3);
+            }
+        }
+    }
+
+    if (captureY4M)
+        fputs("FRAME\n", captureFile);
+    fwrite(captureBuf, 1, plane * 3, captureFile);
+    // target_exit() and target_reset() don't flush stdio, so don't keep frames buffered
+    fflush(captureFile);
 }
 
 //%
@@ -261,12 +544,33 @@ void setPalette(Buffer buf) {
             display->currPalette[i] = (cc << 16) | cc;
         }
     }
+    display->paletteNo++;
     display->newPalette = true;
 }
 
+void WDisplay::addPending(int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0)
+        return;
+    for (int i = 0; i < 2; ++i) {
+        if (pendX0[i] >= pendX1[i]) {
+            pendX0[i] = x;
+            pendY0[i] = y;
+            pendX1[i] = x + w;
+            pendY1[i] = y + h;
+        } else {
+            pendX0[i] = min((int)pendX0[i], x);
+            pendY0[i] = min((int)pendY0[i], y);
+            pendX1[i] = max((int)pendX1[i], x + w);
+            pendY1[i] = max((int)pendY1[i], y + h);
+        }
+    }
+}
+
 void WDisplay::update(Image_ img) {
+    bool full = false;
     if (img && img != lastImg) {
         lastImg = img;
+        full = true;
     }
     img = lastImg;
 
@@ -274,23 +578,56 @@ void WDisplay::update(Image_ img) {
         if (img->bpp() != 4 || img->width() != width || img->height() != height)
             target_panic(PANIC_SCREEN_ERROR);
 
-        if (!painted) {
-            // race is possible (though very unlikely), but in such case we just
-            // wait for next frame paint
-            waitForEvent(DEVICE_ID_NOTIFY, eventId);
-        }
-        painted = false;
-
-        pthread_mutex_lock(&mutex);
-        dirty = true;
+        int x, y, w, h;
         if (newPalette) {
             newPalette = false;
+            full = true;
         }
-        memcpy(screenBuf, img->pix(), img->pixLength());
+        if (full) {
+            x = y = 0;
+            w = width;
+            h = height;
+        } else if (!img->getDirty(&x, &y, &w, &h)) {
+            // the capture has a fixed frame rate, so it still needs a frame
+            if (!captureFile)
+                return;
+            x = y = w = h = 0;
+        }
+        img->clearDirty();
+
+        auto now = current_time_us();
+        auto renderUs = lastUpdate ? now - lastUpdate : 0;
+        lastUpdate = now;
+
+        // the back buffer holds an older frame, so copy all of it; this is cheap compared
+        // to painting, which is still limited to the changed area
+        memcpy(frames[backBuf], img->pix(), width * colBytes);
+
+        pthread_mutex_lock(&mutex);
+        if (renderUs)
+            stats.lastRenderUs = renderUs;
+        addPending(x, y, w, h);
+        // when capturing, keep every frame rather than dropping it
+        while (captureFile && frameReady)
+            pthread_cond_wait(&frameTaken, &mutex);
+        if (frameReady)
+            stats.numDropped++;
+        swap(backBuf, readyBuf);
+        frameReady = true;
+        pthread_cond_signal(&frameCond);
         pthread_mutex_unlock(&mutex);
     }
 }
 
+//% expose
+Buffer getScreenStats() {
+    auto display = getWDisplay();
+    pthread_mutex_lock(&display->mutex);
+    auto stats = display->stats;
+    pthread_mutex_unlock(&display->mutex);
+    return mkBuffer((uint8_t *)&stats, sizeof(stats));
+}
+
 //%
 void updateScreen(Image_ img) {
     getWDisplay()->update(img);
@@ -300,4 +637,112 @@ void updateScreen(Image_ img) {
 void updateStats(String msg) {
     // DMESG("render: %s", msg->data);
 }
+
+// Runs runColumnBands() jobs on SCREEN_THREADS threads (counting the caller); off by default.
+class BandWorkers {
+  public:
+    int numThreads;
+    pthread_mutex_t mutex;
+    pthread_cond_t started;
+    pthread_cond_t finished;
+
+    // current job
+    void (*fn)(void *ctx, int x0, int x1);
+    void *ctx;
+    int width;
+    uint32_t jobNo;
+    int pending;
+
+    BandWorkers();
+    void run(int width, void (*fn)(void *ctx, int x0, int x1), void *ctx);
+    void workerLoop(int idx);
+    int bandStart(int idx) { return width * idx / numThreads; }
+};
+
+SINGLETON(BandWorkers);
+
+struct BandWorkerArg {
+    BandWorkers *workers;
+    int idx;
+};
+
+static void *bandWorker(void *p) {
+    auto arg = (BandWorkerArg *)p;
+    arg->workers->workerLoop(arg->idx);
+    return NULL;
+}
+
+BandWorkers::BandWorkers() {
+    numThreads = getConfigInt("SCREEN_THREADS", 1);
+    if (numThreads < 1)
+        numThreads = 1;
+    if (numThreads > 16)
+        numThreads = 16;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&started, NULL);
+    pthread_cond_init(&finished, NULL);
+    fn = NULL;
+    ctx = NULL;
+    width = 0;
+    jobNo = 0;
+    pending = 0;
+
+    DMESG("screen threads: %d", numThreads);
+
+    for (int i = 1; i < numThreads; ++i) {
+        auto arg = new BandWorkerArg;
+        arg->workers = this;
+        arg->idx = i;
+        pthread_t thr;
+        pthread_create(&thr, NULL, bandWorker, arg);
+        pthread_detach(thr);
+    }
+}
+
+void BandWorkers::workerLoop(int idx) {
+    uint32_t lastJob = 0;
+    for (;;) {
+        pthread_mutex_lock(&mutex);
+        while (jobNo == lastJob)
+            pthread_cond_wait(&started, &mutex);
+        lastJob = jobNo;
+        pthread_mutex_unlock(&mutex);
+
+        // fn, ctx and width don't change until all bands are done
+        fn(ctx, bandStart(idx), bandStart(idx + 1));
+
+        pthread_mutex_lock(&mutex);
+        if (--pending == 0)
+            pthread_cond_signal(&finished);
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+void BandWorkers::run(int width_, void (*fn_)(void *ctx, int x0, int x1), void *ctx_) {
+    pthread_mutex_lock(&mutex);
+    fn = fn_;
+    ctx = ctx_;
+    width = width_;
+    pending = numThreads - 1;
+    jobNo++;
+    pthread_cond_broadcast(&started);
+    pthread_mutex_unlock(&mutex);
+
+    fn(ctx, 0, bandStart(1));
+
+    pthread_mutex_lock(&mutex);
+    while (pending > 0)
+        pthread_cond_wait(&finished, &mutex);
+    pthread_mutex_unlock(&mutex);
+}
+
+void runColumnBands(int width, void (*fn)(void *ctx, int x0, int x1), void *ctx) {
+    auto workers = getBandWorkers();
+    // not worth waking up the workers for narrow images
+    if (workers->numThreads == 1 || width < workers->numThreads * 16)
+        fn(ctx, 0, width);
+    else
+        workers->run(width, fn, ctx);
+}
 } // namespace pxt
\ No newline at end of file
@@ -34,4 +34,44 @@ namespace _screen_internal {
 
         return img as ScreenImage;
     }
-}
\ No newline at end of file
+}
+namespace control {
+    //% shim=pxt::getScreenStats
+    function getScreenStats(): Buffer {
+        return null
+    }
+
+    export interface ScreenStats {
+        numFrames: number;
+        numDropped: number;
+        lastConvertUs: number;
+        maxConvertUs: number;
+        lastWaitUs: number;
+        lastFrameUs: number;
+        targetFps: number;
+        lastRenderUs: number;
+    }
+
+    /**
+     * Get statistics about frames shown by the display thread
+     */
+    export function screenStats(): ScreenStats {
+        const buf = getScreenStats()
+        if (!buf)
+            return null
+        return {
+            numFrames: field(0),
+            numDropped: field(1),
+            lastConvertUs: field(2),
+            maxConvertUs: field(3),
+            lastWaitUs: field(4),
+            lastFrameUs: field(5),
+            targetFps: field(6),
+            lastRenderUs: field(7),
+        }
+
+        function field(i: number) {
+            return buf.getNumber(NumberFormat.UInt32LE, i * 4)
+        }
+    }
+}
@@ -23,6 +23,12 @@ class WDisplay {
 
     uint8_t *screenBuf;
     Image_ lastStatus;
+    // only compared against, to detect when a different image is shown
+    void *lastImg;
+    // screenBuf doesn't hold the last main image, or the palette changed
+    bool fullRefresh;
+    // the address window only covers some columns
+    bool columnWindow;
 
     uint16_t width, height;
     uint16_t displayHeight;
@@ -127,6 +133,8 @@ class WDisplay {
         lastStatus = NULL;
         registerGC((TValue *)&lastStatus);
         inUpdate = false;
+        lastImg = NULL;
+        fullRefresh = true;
     }
 
     uint32_t smartConfigure(uint32_t *cfg0, uint32_t *cfg1, uint32_t *cfg2) {
@@ -200,11 +208,17 @@ class WDisplay {
             smart->setAddrWindow(offX, offY + displayHeight, width, height - displayHeight);
     }
     void setAddrMain() {
+        columnWindow = false;
         if (lcd)
             lcd->setAddrWindow(offX, offY, width, displayHeight);
         else
             smart->setAddrWindow(offX, offY, width, displayHeight);
     }
+    // columns [x, x+w) of the main area
+    void setAddrColumns(int x, int w) {
+        lcd->setAddrWindow(offX + x, offY, w, displayHeight);
+        columnWindow = true;
+    }
     void waitForSendDone() {
         if (lcd)
             lcd->waitForSendDone();
@@ -334,16 +348,36 @@ void updateScreen(Image_ img) {
 
         if (display->newPalette) {
             display->newPalette = false;
+            display->fullRefresh = true;
         } else {
             // smart mode always sends palette
             if (!display->smart)
                 palette = NULL;
         }
 
-        memcpy(display->screenBuf, img->pix(), img->pixLength());
+        int x, y, w, h;
+        bool partial = display->lcd && !display->doubleSize && !display->fullRefresh &&
+                       img == display->lastImg;
+        if (partial && !img->getDirty(&x, &y, &w, &h)) {
+            // nothing changed
+        } else if (partial && w < img->width()) {
+            // only send the changed columns
+            auto colBytes = img->byteHeight();
+            memcpy(display->screenBuf + x * colBytes, img->pix(x, 0), w * colBytes);
+            display->setAddrColumns(x, w);
+            display->sendIndexedImage(display->screenBuf + x * colBytes, w, img->height(),
+                                      palette);
+        } else {
+            if (display->columnWindow)
+                display->setAddrMain();
+            memcpy(display->screenBuf, img->pix(), img->pixLength());
 
-        // DMESG("send");
-        display->sendIndexedImage(display->screenBuf, img->width(), img->height(), palette);
+            // DMESG("send");
+            display->sendIndexedImage(display->screenBuf, img->width(), img->height(), palette);
+        }
+        img->clearDirty();
+        display->lastImg = img;
+        display->fullRefresh = false;
     }
 
     if (display->lastStatus && !display->doubleSize) {
@@ -353,6 +387,7 @@ void updateScreen(Image_ img) {
         if (img->bpp() != 4 || barHeight != img->height() || img->width() != display->width)
             target_panic(PANIC_SCREEN_ERROR);
         memcpy(display->screenBuf, img->pix(), img->pixLength());
+        display->fullRefresh = true; // screenBuf no longer has the main image
         display->setAddrStatus();
         display->sendIndexedImage(display->screenBuf, img->width(), img->height(), NULL);
         display->waitForSendDone();
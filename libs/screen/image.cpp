@@ -8,6 +8,18 @@
 #error "Invalid IMAGE_BITS"
 #endif
 
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_BLIT_SSE2 1
+#if defined(__x86_64__) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define IMAGE_BLIT_AVX2 1
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMAGE_BLIT_NEON 1
+#endif
+
 #define XX(v) (int)(((int16_t)(v)))
 #define YY(v) (int)(((int16_t)(((int32_t)(v)) >> 16)))
 
@@ -29,11 +41,59 @@ int RefImage::wordHeight() {
 
 void RefImage::makeWritable() {
     ++revision;
+    dirtyX0 = dirtyY0 = 0;
+    dirtyX1 = dirtyY1 = INT16_MAX;
+    if (buffer->isReadOnly()) {
+        buffer = mkBuffer(data(), length());
+        gcWriteBarrier(this, (TValue)buffer);
+        opaqueSpans = NULL;
+    }
+}
+
+void RefImage::makeWritable(int x, int y, int w, int h) {
+    ++revision;
+    markDirty(x, y, w, h);
     if (buffer->isReadOnly()) {
         buffer = mkBuffer(data(), length());
+        gcWriteBarrier(this, (TValue)buffer);
+        opaqueSpans = NULL;
     }
 }
 
+void RefImage::markDirty(int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0)
+        return;
+    int x1 = min(x + w, (int)INT16_MAX);
+    int y1 = min(y + h, (int)INT16_MAX);
+    x = max(x, 0);
+    y = max(y, 0);
+    if (x >= x1 || y >= y1)
+        return;
+    if (dirtyX0 >= dirtyX1) {
+        dirtyX0 = x;
+        dirtyY0 = y;
+        dirtyX1 = x1;
+        dirtyY1 = y1;
+    } else {
+        dirtyX0 = min((int)dirtyX0, x);
+        dirtyY0 = min((int)dirtyY0, y);
+        dirtyX1 = max((int)dirtyX1, x1);
+        dirtyY1 = max((int)dirtyY1, y1);
+    }
+}
+
+bool RefImage::getDirty(int *x, int *y, int *w, int *h) {
+    int x1 = min((int)dirtyX1, width());
+    int y1 = min((int)dirtyY1, height());
+    if (dirtyX0 >= x1 || dirtyY0 >= y1)
+        return false;
+    *x = dirtyX0;
+    *y = dirtyY0;
+    *w = x1 - dirtyX0;
+    *h = y1 - dirtyY0;
+    return true;
+}
+
 uint8_t RefImage::fillMask(color c) {
     return this->bpp() == 1 ? (c & 1) * 0xff : 0x11 * (c & 0xf);
 }
@@ -49,6 +109,13 @@ void RefImage::clamp(int *x, int *y) {
 
 RefImage::RefImage(BoxedBuffer *buf) : PXT_VTABLE_INIT(RefImage), buffer(buf) {
     revision = 0;
+    // new images are dirty all over
+    dirtyX0 = dirtyY0 = 0;
+    dirtyX1 = dirtyY1 = INT16_MAX;
+    collisionMask = NULL;
+    maskRevision = 0;
+    opaqueSpans = NULL;
+    spansChecked = false;
     if (!buf)
         oops(21);
 }
@@ -114,6 +181,13 @@ bool isLegacyImage(Buffer buf) {
     return true;
 }
 
+// Serial by default; targets with threads can override it. Every column must only be written by
+// the band that contains it, so that the result doesn't depend on how the columns were split.
+__attribute__((weak)) void runColumnBands(int width, void (*fn)(void *ctx, int x0, int x1),
+                                          void *ctx) {
+    fn(ctx, 0, width);
+}
+
 } // namespace pxt
 
 namespace ImageMethods {
@@ -202,7 +276,7 @@ static int getCore(Image_ img, int x, int y) {
 void setPixel(Image_ img, int x, int y, int c) {
     if (!img->inRange(x, y))
         return;
-    img->makeWritable();
+    img->makeWritable(x, y, 1, 1);
     setCore(img, x, y, c);
 }
 
@@ -268,7 +342,7 @@ void setRows(Image_ img, int x, Buffer src) {
     if (x >= w || x < 0)
         return;
 
-    img->makeWritable();
+    img->makeWritable(x, 0, w - x, h);
 
     uint8_t *dp = img->pix(x, 0);
     uint8_t *sp = src->data;
@@ -280,6 +354,56 @@ void setRows(Image_ img, int x, Buffer src) {
     }
 }
 
+// Fill h pixels of a column, starting at row y, which is in the byte at p; f is fillMask(c).
+// No clipping.
+static void fillColumn(Image_ img, uint8_t *ptr, int y, int h, int c, uint8_t f) {
+    if (img->bpp() == 1) {
+        unsigned mask = 0x01 << (y & 7);
+
+        for (int i = 0; i < h; ++i) {
+            if (mask == 0x100) {
+                if (h - i >= 8) {
+                    *++ptr = f;
+                    i += 7;
+                    continue;
+                } else {
+                    mask = 0x01;
+                    ++ptr;
+                }
+            }
+            if (c)
+                *ptr |= mask;
+            else
+                *ptr &= ~mask;
+            mask <<= 1;
+        }
+    } else if (img->bpp() == 4) {
+        if (h <= 0)
+            return;
+        if (y & 1) {
+            *ptr = (*ptr & 0x0f) | (f & 0xf0);
+            ptr++;
+            h--;
+        }
+        memset(ptr, f, h >> 1);
+        if (h & 1) {
+            ptr += h >> 1;
+            *ptr = (*ptr & 0xf0) | (f & 0x0f);
+        }
+    }
+}
+
+// Fill rows [y0, y1] of column x, clipped to the image; makeWritable() is up to the caller.
+static void fillSpan(Image_ img, int x, int y0, int y1, int c) {
+    if (x < 0 || x >= img->width())
+        return;
+    y0 = max(y0, 0);
+    y1 = min(y1, img->height() - 1);
+    if (y0 > y1)
+        return;
+    fillColumn(img, img->pix(x, y0), y0, y1 - y0 + 1, c, img->fillMask(c));
+}
+
 void fillRect(Image_ img, int x, int y, int w, int h, int c) {
     if (w == 0 || h == 0 || x >= img->width() || y >= img->height())
         return;
@@ -300,56 +424,14 @@ void fillRect(Image_ img, int x, int y, int w, int h, int c) {
         return;
     }
 
-    img->makeWritable();
+    img->makeWritable(x, y, w, h);
 
     auto bh = img->byteHeight();
     uint8_t f = img->fillMask(c);
 
     uint8_t *p = img->pix(x, y);
     while (w-- > 0) {
-        if (img->bpp() == 1) {
-            auto ptr = p;
-            unsigned mask = 0x01 << (y & 7);
-
-            for (int i = 0; i < h; ++i) {
-                if (mask == 0x100) {
-                    if (h - i >= 8) {
-                        *++ptr = f;
-                        i += 7;
-                        continue;
-                    } else {
-                        mask = 0x01;
-                        ++ptr;
-                    }
-                }
-                if (c)
-                    *ptr |= mask;
-                else
-                    *ptr &= ~mask;
-                mask <<= 1;
-            }
-
-        } else if (img->bpp() == 4) {
-            auto ptr = p;
-            unsigned mask = 0x0f;
-            if (y & 1)
-                mask <<= 4;
-
-            for (int i = 0; i < h; ++i) {
-                if (mask == 0xf00) {
-                    if (h - i >= 2) {
-                        *++ptr = f;
-                        i++;
-                        continue;
-                    } else {
-                        mask = 0x0f;
-                        ptr++;
-                    }
-                }
-                *ptr = (*ptr & ~mask) | (f & mask);
-                mask <<= 4;
-            }
-        }
+        fillColumn(img, p, y, h, c, f);
         p += bh;
     }
 }
@@ -377,7 +459,7 @@ void mapRect(Image_ img, int x, int y, int w, int h, Buffer map) {
     w = x2 - x + 1;
     h = y2 - y + 1;
 
-    img->makeWritable();
+    img->makeWritable(x, y, w, h);
 
     auto bh = img->byteHeight();
     auto m = map->data;
@@ -625,15 +707,228 @@ Image_ doubled(Image_ img) {
     return r;
 }
 
-bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
+// Transparent blit of n 4bpp bytes (two pixels each): every non-zero source nibble replaces
+// the destination nibble. With 'shifted', the source starts at the high nibble of src[0],
+// and src[n] is read as well.
+// The kernels below return the number of bytes they handled; the rest goes to the scalar loop.
+
+#ifdef IMAGE_BLIT_SSE2
+static int blitTransparent4SSE2(uint8_t *dst, const uint8_t *src, int n, bool shifted) {
+    const __m128i lo = _mm_set1_epi8(0x0f);
+    const __m128i hi = _mm_set1_epi8((char)0xf0);
+    const __m128i zero = _mm_setzero_si128();
+    int k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + k));
+        if (shifted) {
+            auto next = _mm_loadu_si128((const __m128i *)(src + k + 1));
+            s = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(s, 4), lo),
+                             _mm_and_si128(_mm_slli_epi16(next, 4), hi));
+        }
+        // keep destination bits where the source nibble is zero
+        auto keep = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(s, lo), zero), lo),
+                                 _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(s, hi), zero), hi));
+        auto d = _mm_loadu_si128((const __m128i *)(dst + k));
+        _mm_storeu_si128((__m128i *)(dst + k), _mm_or_si128(_mm_and_si128(d, keep), s));
+    }
+    return k;
+}
+#endif
+
+#ifdef IMAGE_BLIT_AVX2
+__attribute__((target("avx2"))) static int blitTransparent4AVX2(uint8_t *dst, const uint8_t *src,
+                                                                int n, bool shifted) {
+    const __m256i lo = _mm256_set1_epi8(0x0f);
+    const __m256i hi = _mm256_set1_epi8((char)0xf0);
+    const __m256i zero = _mm256_setzero_si256();
+    int k = 0;
+    for (; k + 32 <= n; k += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + k));
+        if (shifted) {
+            auto next = _mm256_loadu_si256((const __m256i *)(src + k + 1));
+            s = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(s, 4), lo),
+                                _mm256_and_si256(_mm256_slli_epi16(next, 4), hi));
+        }
+        auto keep =
+            _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(s, lo), zero), lo),
+                            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(s, hi), zero), hi));
+        auto d = _mm256_loadu_si256((const __m256i *)(dst + k));
+        _mm256_storeu_si256((__m256i *)(dst + k), _mm256_or_si256(_mm256_and_si256(d, keep), s));
+    }
+    return k;
+}
+
+static bool hasAVX2() {
+    static int8_t supported = -1;
+    if (supported < 0)
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return supported;
+}
+#endif
+
+#ifdef IMAGE_BLIT_NEON
+static int blitTransparent4NEON(uint8_t *dst, const uint8_t *src, int n, bool shifted) {
+    const uint8x16_t lo = vdupq_n_u8(0x0f);
+    const uint8x16_t hi = vdupq_n_u8(0xf0);
+    int k = 0;
+    for (; k + 16 <= n; k += 16) {
+        uint8x16_t s = vld1q_u8(src + k);
+        if (shifted)
+            s = vorrq_u8(vshrq_n_u8(s, 4), vshlq_n_u8(vld1q_u8(src + k + 1), 4));
+        // take source bits where the source nibble is non-zero
+        auto take = vorrq_u8(vandq_u8(vtstq_u8(s, lo), lo), vandq_u8(vtstq_u8(s, hi), hi));
+        vst1q_u8(dst + k, vbslq_u8(take, s, vld1q_u8(dst + k)));
+    }
+    return k;
+}
+#endif
+
+static void blitTransparent4(uint8_t *dst, const uint8_t *src, int n, bool shifted) {
+    int k = 0;
+#ifdef IMAGE_BLIT_AVX2
+    if (n >= 32 && hasAVX2())
+        k = blitTransparent4AVX2(dst, src, n, shifted);
+#endif
+#ifdef IMAGE_BLIT_SSE2
+    k += blitTransparent4SSE2(dst + k, src + k, n - k, shifted);
+#endif
+#ifdef IMAGE_BLIT_NEON
+    k = blitTransparent4NEON(dst, src, n, shifted);
+#endif
+    for (; k < n; ++k) {
+        unsigned s = shifted ? (src[k] >> 4) | ((src[k + 1] << 4) & 0xf0) : src[k];
+        if (!s)
+            continue;
+        unsigned keep = ((s & 0x0f) ? 0 : 0x0f) | ((s & 0xf0) ? 0 : 0xf0);
+        dst[k] = (dst[k] & keep) | s;
+    }
+}
+
+// Copy n 4bpp bytes; see blitTransparent4() for 'shifted'.
+static void copy4(uint8_t *dst, const uint8_t *src, int n, bool shifted) {
+    if (!shifted) {
+        memcpy(dst, src, n);
+        return;
+    }
+    for (int k = 0; k < n; ++k)
+        dst[k] = (src[k] >> 4) | (src[k + 1] << 4);
+}
+
+// Draw h pixels of a 4bpp column, starting at source pixel p0, at y0, clipped to [0, sh);
+// unless 'opaque', color 0 is transparent.
+static void blitColumn4(uint8_t *tdata, const uint8_t *fdata, int y0, int h, int sh,
+                        bool opaque = false, int p0 = 0) {
+#define SRCPIX(p) ((fdata[(p) >> 1] >> (((p)&1) << 2)) & 0xf)
+    int yy = max(y0, 0);
+    int yend = min(y0 + h, sh);
+    if (yy >= yend)
+        return;
+    fdata += p0 >> 1;
+    p0 &= 1;
+
+    if (yy & 1) {
+        auto c = SRCPIX(p0 + yy - y0);
+        if (c || opaque)
+            tdata[yy >> 1] = (tdata[yy >> 1] & 0x0f) | (c << 4);
+        yy++;
+    }
+
+    int n = (yend - yy) >> 1;
+    if (n > 0) {
+        int p = p0 + yy - y0;
+        if (opaque)
+            copy4(tdata + (yy >> 1), fdata + (p >> 1), n, p & 1);
+        else
+            blitTransparent4(tdata + (yy >> 1), fdata + (p >> 1), n, p & 1);
+        yy += n << 1;
+    }
+
+    if (yy < yend) {
+        auto c = SRCPIX(p0 + yy - y0);
+        if (c || opaque)
+            tdata[yy >> 1] = (tdata[yy >> 1] & 0xf0) | c;
+    }
+#undef SRCPIX
+}
+
+// Opaque runs of a read-only 4bpp image: w + 1 column offsets into the array, followed by
+// (start, length) pairs of runs. Built on first transparent draw, if the image has enough
+// transparent pixels to make it worthwhile.
+static uint16_t *getOpaqueSpans(Image_ img) {
+    if (img->opaqueSpans || img->spansChecked)
+        return img->opaqueSpans;
+    if (!img->buffer->isReadOnly() || img->bpp() != 4)
+        return NULL;
+    img->spansChecked = true;
+
+    auto w = img->width();
+    auto h = img->height();
+    auto bh = img->byteHeight();
+    auto pix = img->pix();
+
+#define PIX(x, y) ((pix[bh * (x) + ((y) >> 1)] >> (((y)&1) << 2)) & 0xf)
+    int numRuns = 0, numOpaque = 0;
+    for (int x = 0; x < w; ++x) {
+        bool prev = false;
+        for (int y = 0; y < h; ++y) {
+            bool cur = PIX(x, y) != 0;
+            if (cur) {
+                numOpaque++;
+                if (!prev)
+                    numRuns++;
+            }
+            prev = cur;
+        }
+    }
+
+    // mostly opaque or too fragmented images are better off with the regular blit
+    int total = w * h;
+    if (numOpaque * 4 > total * 3 || numRuns * 8 > total)
+        return NULL;
+    int len = w + 1 + numRuns * 2;
+    if (len > 0xffff)
+        return NULL;
+
+    auto spans = (uint16_t *)gcAllocateArray(len * sizeof(uint16_t));
+    img->opaqueSpans = spans;
+    gcAttachArray(img, spans);
+
+    int ptr = w + 1;
+    for (int x = 0; x < w; ++x) {
+        spans[x] = ptr;
+        int start = -1;
+        for (int y = 0; y <= h; ++y) {
+            bool cur = y < h && PIX(x, y) != 0;
+            if (cur && start < 0) {
+                start = y;
+            } else if (!cur && start >= 0) {
+                spans[ptr++] = start;
+                spans[ptr++] = y - start;
+                start = -1;
+            }
+        }
+    }
+    spans[w] = ptr;
+#undef PIX
+
+    return spans;
+}
+
+// only columns in [bx0, bx1) of img are touched (the whole image when bx1 < 0)
+bool drawImageCore(Image_ img, Image_ from, int x, int y, int color, int bx0 = 0, int bx1 = -1) {
     auto w = from->width();
     auto h = from->height();
     auto sh = img->height();
     auto sw = img->width();
 
-    if (x + w <= 0)
+    if (bx1 < 0 || bx1 > sw)
+        bx1 = sw;
+    if (bx0 < 0)
+        bx0 = 0;
+
+    if (x + w <= bx0)
         return false;
-    if (x >= sw)
+    if (x >= bx1)
         return false;
     if (y + h <= 0)
         return false;
@@ -645,7 +940,8 @@ bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
     auto fbp = from->bpp();
     auto y0 = y;
 
-    if (color == -2 && x == 0 && y == 0 && tbp == fbp && w == sw && h == sh) {
+    if (color == -2 && x == 0 && y == 0 && tbp == fbp && w == sw && h == sh && bx0 == 0 &&
+        bx1 == sw) {
         copyFrom(img, from);
         return false;
     }
@@ -660,10 +956,12 @@ bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
 
 #define LOOPHD                                                                                     \
     for (int xx = 0; xx < w; ++xx, ++x)                                                            \
-        if (0 <= x && x < sw)
+        if (bx0 <= x && x < bx1)
 
     if (tbp == 4 && fbp == 4) {
         auto wordH = fromH >> 2;
+        auto colBase = img->pix();
+        auto spans = color >= 0 ? getOpaqueSpans(from) : NULL;
         LOOPHD {
             y = y0;
 
@@ -724,10 +1022,16 @@ bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
         LOOP(STEPA, STEPB, xbot)
 
             if (color >= 0) {
+                if (spans) {
+                    for (int i = spans[xx]; i < spans[xx + 1]; i += 2)
+                        blitColumn4(colBase + imgH * x, (uint8_t *)fdata, y0 + spans[i],
+                                    spans[i + 1], sh, true, spans[i]);
+                } else {
+                    blitColumn4(colBase + imgH * x, (uint8_t *)fdata, y0, h, sh);
+                }
+            } else if (color == -2) {
 #define SETHIGH(s) *tdata = (*tdata & 0x0f) | ((COLS(s)) << 4)
 #define SETLOW(s) *tdata = (*tdata & 0xf0) | COLS(s)
-                LOOPS(sh)
-            } else if (color == -2) {
 #undef COL
 #define COL(s) 1
                 LOOPS(bot)
@@ -835,7 +1139,7 @@ bool drawImageCore(Image_ img, Image_ from, int x, int y, int color) {
  */
 //%
 void drawImage(Image_ img, Image_ from, int x, int y) {
-    img->makeWritable();
+    img->makeWritable(x, y, from->width(), from->height());
     if (img->bpp() == 4 && from->bpp() == 4) {
         drawImageCore(img, from, x, y, -2);
     } else {
@@ -849,16 +1153,366 @@ void drawImage(Image_ img, Image_ from, int x, int y) {
  */
 //%
 void drawTransparentImage(Image_ img, Image_ from, int x, int y) {
-    img->makeWritable();
+    img->makeWritable(x, y, from->width(), from->height());
     drawImageCore(img, from, x, y, 0);
 }
 
+struct ImageListCtx {
+    Image_ img;
+    RefCollection *images;
+    int16_t *rec, *end;
+};
+
+static Image_ imageAt(RefCollection *images, int idx) {
+    if (0 <= idx && idx < (int)images->length()) {
+        auto v = images->getAt(idx);
+        if (isRefCounted(v) && getVTable((RefObject *)v) == &RefImage_vtable)
+            return (Image_)v;
+    }
+    return NULL;
+}
+
+// draw the records touching columns [bx0, bx1); doesn't allocate or update the image state
+static void drawImageListBand(void *p, int bx0, int bx1) {
+    auto ctx = (ImageListCtx *)p;
+    auto img = ctx->img;
+
+    int lastIdx = -1;
+    Image_ from = NULL;
+    int w = 0, h = 0;
+    bool fast = false;
+
+    for (auto rec = ctx->rec; rec < ctx->end; rec += 4) {
+        int idx = rec[0];
+        if (idx != lastIdx) {
+            // only look up the image and its size once for a run of records using it
+            lastIdx = idx;
+            from = imageAt(ctx->images, idx);
+            if (!from)
+                continue;
+            w = from->width();
+            h = from->height();
+            fast = img->bpp() == 4 && from->bpp() == 4;
+        }
+        if (!from)
+            continue;
+
+        int x = rec[1];
+        int y = rec[2];
+        if (x + w <= bx0 || x >= bx1)
+            continue;
+
+        if (rec[3] & 1) {
+            if (fast) {
+                drawImageCore(img, from, x, y, -2, bx0, bx1);
+            } else {
+                for (int cx = max(x, bx0); cx < min(x + w, bx1); ++cx)
+                    fillSpan(img, cx, y, y + h - 1, 0);
+                drawImageCore(img, from, x, y, 0, bx0, bx1);
+            }
+        } else {
+            drawImageCore(img, from, x, y, 0, bx0, bx1);
+        }
+    }
+}
+
+/**
+ * Draw a list of images on the current image in one call. Every 8 byte record in `list` holds
+ * int16 index into `images`, int16 x, int16 y, and uint16 flags (bit 0 - opaque, like drawImage;
+ * otherwise the image is drawn with transparent background).
+ */
+//%
+void drawImageList(Image_ img, RefCollection *images, Buffer list) {
+    img->makeWritable(0, 0, 0, 0); // dirty area is marked per record
+
+    auto sw = img->width();
+    auto sh = img->height();
+    ImageListCtx ctx;
+    ctx.img = img;
+    ctx.images = images;
+    ctx.rec = (int16_t *)list->data;
+    ctx.end = ctx.rec + (list->length >> 3) * 4;
+
+    // mark the dirty area and build the span caches up front, as the bands may run in parallel
+    int lastIdx = -1;
+    Image_ from = NULL;
+    for (auto rec = ctx.rec; rec < ctx.end; rec += 4) {
+        if (rec[0] != lastIdx) {
+            lastIdx = rec[0];
+            from = imageAt(images, lastIdx);
+        }
+        if (!from)
+            continue;
+        // a repeated index can be drawn opaque first and transparent later
+        if (!(rec[3] & 1))
+            getOpaqueSpans(from);
+        int x = rec[1];
+        int y = rec[2];
+        int w = from->width();
+        int h = from->height();
+        if (x + w <= 0 || x >= sw || y + h <= 0 || y >= sh)
+            continue;
+        img->markDirty(x, y, w, h);
+    }
+
+    if (ctx.end - ctx.rec > 4)
+        runColumnBands(sw, drawImageListBand, &ctx);
+    else
+        drawImageListBand(&ctx, 0, sw);
+}
+
+// check if a 4bpp image has no transparent pixels
+static bool isOpaque4(Image_ img) {
+    auto w = img->width();
+    auto h = img->height();
+    for (int x = 0; x < w; ++x) {
+        auto p = img->pix(x, 0);
+        for (int y = 0; y < h; y += 2) {
+            auto v = p[y >> 1];
+            if (!(v & 0x0f) || (y + 1 < h && !(v & 0xf0)))
+                return false;
+        }
+    }
+    return true;
+}
+
+struct TileMapCtx {
+    Image_ img;
+    RefCollection *tileset;
+    uint8_t *tileData;
+    int mapW, mapH, scale;
+    int offX, offY, x0, xn, y0, yn;
+    // per tile index: 1 - draw with transparency, 2 - opaque, 3 - unused, 4 - not an image
+    uint8_t kind[256];
+};
+
+static void drawTileMapBand(void *p, int bx0, int bx1) {
+    auto ctx = (TileMapCtx *)p;
+    auto img = ctx->img;
+    auto scale = ctx->scale;
+    int size = 1 << scale;
+    auto sh = img->height();
+    auto imgH = img->byteHeight();
+    auto tbase = img->pix();
+    bool target4 = img->bpp() == 4;
+
+    for (int x = ctx->x0; x <= ctx->xn; ++x) {
+        int px = ((x - ctx->x0) << scale) - ctx->offX;
+        if (px >= bx1 || px + size <= bx0)
+            continue;
+        for (int y = ctx->y0; y <= ctx->yn; ++y) {
+            int py = ((y - ctx->y0) << scale) - ctx->offY;
+            if (py >= sh || py + size <= 0)
+                continue;
+            int idx = (x < ctx->mapW && y < ctx->mapH) ? ctx->tileData[x + y * ctx->mapW] : 0;
+            if (ctx->kind[idx] > 2)
+                continue;
+
+            auto tile = (Image_)ctx->tileset->getAt(idx);
+            auto tw = min(tile->width(), size);
+            auto th = min(tile->height(), size);
+            if (!target4 || tile->bpp() != 4) {
+                // same as drawImageCore(img, tile, px, py, 0), clipped to the tile cell
+                if (!target4 && tile->bpp() == 4)
+                    continue;
+                bool sameBpp = img->bpp() == tile->bpp();
+                for (int cx = max(0, bx0 - px); cx < tw && px + cx < bx1; ++cx)
+                    for (int cy = max(0, -py); cy < th && py + cy < sh; ++cy) {
+                        auto c = getCore(tile, cx, cy);
+                        if (c)
+                            setCore(img, px + cx, py + cy, sameBpp ? c : 0);
+                    }
+                continue;
+            }
+
+            auto tileH = tile->byteHeight();
+            auto fbase = tile->pix();
+            auto spans = ctx->kind[idx] == 1 ? getOpaqueSpans(tile) : NULL;
+            for (int cx = max(0, bx0 - px); cx < tw && px + cx < bx1; ++cx) {
+                auto tcol = tbase + imgH * (px + cx);
+                auto fcol = fbase + tileH * cx;
+                if (spans) {
+                    for (int i = spans[cx]; i < spans[cx + 1]; i += 2) {
+                        int start = spans[i];
+                        blitColumn4(tcol, fcol, py + start, min((int)spans[i + 1], th - start), sh,
+                                    true, start);
+                    }
+                } else {
+                    blitColumn4(tcol, fcol, py, th, sh, ctx->kind[idx] == 2);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Draw the visible part of a tile map. `tiles` holds uint16 width and height followed by one
+ * tile index per byte, row by row. Tiles are 1 << scale pixels wide and larger tileset images
+ * are clipped to that. `params` packs scale (bits 0-2), camera x (signed, bits 3-16) and
+ * camera y (signed, bits 17-31).
+ */
+//%
+void _drawTileMap(Image_ img, Buffer tiles, RefCollection *tileset, int params) {
+    if (tiles->length < 4)
+        return;
+
+    int scale = params & 7;
+    int camX = (int32_t)((uint32_t)params << 15) >> 18;
+    int camY = params >> 17;
+    int size = 1 << scale;
+    int mask = size - 1;
+
+    int mapW = tiles->data[0] | (tiles->data[1] << 8);
+    int mapH = tiles->data[2] | (tiles->data[3] << 8);
+    auto tileData = tiles->data + 4;
+    if ((int)tiles->length < 4 + mapW * mapH)
+        return;
+
+    TileMapCtx ctx;
+    ctx.img = img;
+    ctx.tileset = tileset;
+    ctx.tileData = tileData;
+    ctx.mapW = mapW;
+    ctx.mapH = mapH;
+    ctx.scale = scale;
+
+    auto sw = img->width();
+    auto sh = img->height();
+    ctx.offX = camX & mask;
+    ctx.offY = camY & mask;
+    ctx.x0 = max(0, camX >> scale);
+    ctx.xn = min(mapW, ((camX + sw) >> scale) + 1);
+    ctx.y0 = max(0, camY >> scale);
+    ctx.yn = min(mapH, ((camY + sh) >> scale) + 1);
+
+    img->makeWritable();
+
+    auto numTiles = min((int)tileset->length(), 256);
+    memset(ctx.kind, 3, sizeof(ctx.kind));
+    bool target4 = img->bpp() == 4;
+
+    // classify the tiles that are used up front, as the bands may run in parallel
+    for (int y = ctx.y0; y <= ctx.yn; ++y) {
+        for (int x = ctx.x0; x <= ctx.xn; ++x) {
+            // outside of the map is tile 0, as in the script version
+            int idx = (x < mapW && y < mapH) ? tileData[x + y * mapW] : 0;
+            if (idx >= numTiles || ctx.kind[idx] != 3)
+                continue;
+            auto v = tileset->getAt(idx);
+            if (isRefCounted(v) && getVTable((RefObject *)v) == &RefImage_vtable) {
+                auto t = (Image_)v;
+                ctx.kind[idx] = target4 && t->bpp() == 4 && isOpaque4(t) ? 2 : 1;
+                if (ctx.kind[idx] == 1)
+                    getOpaqueSpans(t);
+            } else {
+                ctx.kind[idx] = 4;
+            }
+        }
+    }
+
+    runColumnBands(sw, drawTileMapBand, &ctx);
+}
+
+// Get the (cached) collision mask of an image, see RefImage::collisionMask
+static uint32_t *getCollisionMask(Image_ img) {
+    if (img->collisionMask && img->maskRevision == img->revision)
+        return img->collisionMask;
+
+    auto w = img->width();
+    auto h = img->height();
+    auto mw = (h + 31) >> 5;
+    if (!img->collisionMask) {
+        auto mask = (uint32_t *)gcAllocateArray(max(w * mw, 1) * sizeof(uint32_t));
+        img->collisionMask = mask;
+        gcAttachArray(img, mask);
+    }
+    auto mask = img->collisionMask;
+    memset(mask, 0, w * mw * sizeof(uint32_t));
+
+    auto bh = img->byteHeight();
+    auto pix = img->pix();
+    for (int x = 0; x < w; ++x) {
+        auto col = pix + bh * x;
+        auto dst = mask + mw * x;
+        if (img->bpp() == 1) {
+            memcpy(dst, col, bh);
+            // clear padding bits
+            if (h & 31)
+                dst[mw - 1] &= (1U << (h & 31)) - 1;
+        } else {
+            for (int y = 0; y < h; ++y) {
+                auto v = col[y >> 1] >> ((y & 1) << 2);
+                if (v & 0xf)
+                    dst[y >> 5] |= 1U << (y & 31);
+            }
+        }
+    }
+    img->maskRevision = img->revision;
+    return mask;
+}
+
+// check if non-transparent pixels of 'other' at (x, y) overlap with these of 'img'
+static bool overlapsCore(Image_ img, Image_ other, int x, int y) {
+    auto w = other->width();
+    auto h = other->height();
+    auto sw = img->width();
+    auto sh = img->height();
+    if (x + w <= 0 || x >= sw || y + h <= 0 || y >= sh)
+        return false;
+
+    auto omask = getCollisionMask(other);
+    auto imask = getCollisionMask(img);
+
+    int imw = (sh + 31) >> 5;
+    int omw = (h + 31) >> 5;
+    // row y in 'img' is row 0 in 'other'
+    int q = y >> 5; // floor, also for negative y
+    int s = y & 31;
+
+    int x0 = max(0, -x);
+    int x1 = min(w, sw - x);
+    for (int cx = x0; cx < x1; ++cx) {
+        auto a = imask + imw * (cx + x);
+        auto b = omask + omw * cx;
+        for (int j = 0; j < omw; ++j) {
+            auto bits = b[j];
+            if (!bits)
+                continue;
+            int k = q + j;
+            if (0 <= k && k < imw && (a[k] & (bits << s)))
+                return true;
+            if (s && 0 <= k + 1 && k + 1 < imw && (a[k + 1] & (bits >> (32 - s))))
+                return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Check if the current image "collides" with another
  */
 //%
 bool overlapsWith(Image_ img, Image_ other, int x, int y) {
-    return drawImageCore(img, other, x, y, -1);
+    return overlapsCore(img, other, x, y);
+}
+
+/**
+ * Check the current image against a list of images, at positions given in `positions` as
+ * pairs of int16 x and y. Returns a buffer with 1 for each image that overlaps and 0 otherwise.
+ */
+//%
+Buffer overlapsWithList(Image_ img, RefCollection *others, Buffer positions) {
+    auto num = min((int)others->length(), (int)positions->length >> 2);
+    auto res = mkBuffer(NULL, num);
+    registerGCObj(res);
+    auto pos = (int16_t *)positions->data;
+    for (int i = 0; i < num; ++i) {
+        auto v = others->getAt(i);
+        if (isRefCounted(v) && getVTable((RefObject *)v) == &RefImage_vtable)
+            res->data[i] = overlapsCore(img, (Image_)v, pos[i * 2], pos[i * 2 + 1]);
+    }
+    unregisterGCObj(res);
+    return res;
 }
 
 // Image_ format (legacy)
@@ -897,15 +1551,166 @@ Image_ convertAndWrap(Buffer buf) {
 
 //%
 void _drawIcon(Image_ img, Buffer icon, int xy, int c) {
-    img->makeWritable();
-
     auto iconImg = convertAndWrap(icon);
     if (!iconImg || iconImg->bpp() != 1)
         return;
 
+    img->makeWritable(XX(xy), YY(xy), iconImg->width(), iconImg->height());
+
     drawImageCore(img, iconImg, XX(xy), YY(xy), c);
 }
 
+// Offsets of recently used glyphs in read-only (flash) fonts, which never move or go away.
+#define GLYPH_CACHE_SIZE 64
+struct GlyphCacheEntry {
+    const uint8_t *font;
+    uint32_t ch;
+    uint32_t offset;
+};
+static GlyphCacheEntry glyphCache[GLYPH_CACHE_SIZE];
+
+// Find the glyph for 'ch' in font data made of (uint16 char code, glyph bitmap) entries of
+// dataSize bytes, sorted by char code; the first glyph (space) is used when it's not there.
+static uint32_t findGlyph(Buffer font, uint32_t ch, int dataSize) {
+    auto data = font->data;
+    GlyphCacheEntry *e = NULL;
+    if (font->isReadOnly()) {
+        e = &glyphCache[ch % GLYPH_CACHE_SIZE];
+        if (e->font == data && e->ch == ch)
+            return e->offset;
+    }
+
+#define GLYPH_CODE(idx) (uint32_t)(data[(idx)*dataSize] | (data[(idx)*dataSize + 1] << 8))
+    int lastchar = font->length / dataSize - 1;
+    uint32_t off = 0;
+    int guess = (int)ch - 32;
+    if (0 <= guess && guess <= lastchar && GLYPH_CODE(guess) == ch) {
+        off = guess * dataSize;
+    } else {
+        int l = 0;
+        int r = lastchar;
+        while (l <= r) {
+            int m = l + ((r - l) >> 1);
+            uint32_t v = GLYPH_CODE(m);
+            if (v == ch) {
+                off = m * dataSize;
+                break;
+            }
+            if (v < ch)
+                l = m + 1;
+            else
+                r = m - 1;
+        }
+    }
+#undef GLYPH_CODE
+
+    if (e) {
+        e->font = data;
+        e->ch = ch;
+        e->offset = off;
+    }
+    return off;
+}
+
+// read the character at p and advance past it, decoding the same way as charCodeAt()
+static uint32_t nextCharCode(const char *&p, const char *end) {
+#if PXT_UTF8
+    uint32_t c = utf8CharCode(p);
+    p = utf8Skip(p, end - p, 1);
+    if (!p)
+        p = end;
+    return c;
+#else
+    return (uint8_t)*p++;
+#endif
+}
+
+/**
+ * Print text using 1bpp font data, as in image.Font. `params` holds Int16LE x and y, followed
+ * by UInt8 color, multiplier, and width and height of glyphs in font data (before multiplying).
+ */
+//%
+void _printRun(Image_ img, String text, Buffer font, Buffer params) {
+    if (params->length < 8)
+        return;
+    auto pp = params->data;
+    int x = (int16_t)(pp[0] | (pp[1] << 8));
+    int y = (int16_t)(pp[2] | (pp[3] << 8));
+    int color = pp[4];
+    int mult = max((int)pp[5], 1);
+    int dataW = pp[6];
+    int dataH = pp[7];
+
+    int byteHeight = (dataH + 7) >> 3;
+    int dataSize = 2 + byteHeight * dataW;
+    if (!dataW || (int)font->length < dataSize)
+        return;
+
+    int charW = dataW * mult;
+    int charH = dataH * mult;
+    int x0 = x;
+    auto sw = img->width();
+    auto sh = img->height();
+    bool fast = img->bpp() == 4 && mult == 1;
+    if (img->bpp() == 4)
+        color &= 0xf;
+
+    auto p = text->getUTF8Data();
+    auto end = p + text->getUTF8Size();
+
+    while (p < end) {
+        auto ch = nextCharCode(p, end);
+        if (ch == 10) {
+            y += charH + 2;
+            x = x0;
+        }
+        if (ch < 32)
+            continue; // skip control chars
+
+        if (x >= sw || x + charW <= 0 || y >= sh || y + charH <= 0) {
+            x += charW;
+            continue;
+        }
+
+        auto glyph = font->data + findGlyph(font, ch, dataSize) + 2;
+        if (mult == 1)
+            img->makeWritable(x, y, charW, charH);
+
+        for (int i = 0; i < dataW; ++i, glyph += byteHeight) {
+            int cx = x + i * mult;
+            if (cx + mult <= 0 || cx >= sw)
+                continue;
+            int j = 0;
+            while (j < dataH) {
+                if (!(glyph[j >> 3] & (1 << (j & 7)))) {
+                    j++;
+                    continue;
+                }
+                int n = 1;
+                while (j + n < dataH && (glyph[(j + n) >> 3] & (1 << ((j + n) & 7))))
+                    n++;
+                if (mult > 1) {
+                    fillRect(img, cx, y + j * mult, mult, n * mult, color);
+                } else {
+                    for (int k = max(y + j, 0); k < min(y + j + n, sh); ++k) {
+                        if (fast) {
+                            auto ptr = img->pix(cx, k);
+                            if (k & 1)
+                                *ptr = (*ptr & 0x0f) | (color << 4);
+                            else
+                                *ptr = (*ptr & 0xf0) | color;
+                        } else {
+                            setCore(img, cx, k, color);
+                        }
+                    }
+                }
+                j += n;
+            }
+        }
+        x += charW;
+    }
+}
+
 static void drawLineLow(Image_ img, int x0, int y0, int x1, int y1, int c) {
     int dx = x1 - x0;
     int dy = y1 - y0;
@@ -1012,7 +1817,7 @@ void drawLine(Image_ img, int x0, int y0, int x1, int y1, int c) {
         }
     }
 
-    img->makeWritable();
+    img->makeWritable(x0, min(y0, y1), x1 - x0 + 1, abs(y1 - y0) + 1);
 
     if (h < 0) {
         h = -h;
@@ -1050,6 +1855,8 @@ void blitRow(Image_ img, int x, int y, Image_ from, int fromX, int fromH) {
         y = 0;
     }
 
+    img->makeWritable(x, y, 1, endY - y);
+
     auto dp = img->pix(x, y);
     auto sp = from->pix(fromX, 0);
 
@@ -1075,31 +1882,201 @@ void _blitRow(Image_ img, int xy, Image_ from, int xh) {
     blitRow(img, XX(xy), YY(xy), from, XX(xh), YY(xh));
 }
 
+/**
+ * Draw an image transformed by a 2x3 matrix, given as six Int32LE numbers in 16.16 fixed point
+ * (a, b, c, d, e, f). Source pixel (x, y) lands at (a*x + b*y + c, d*x + e*y + f).
+ * Unless `opaque`, color 0 is transparent.
+ */
+//%
+void drawImageTransformed(Image_ img, Image_ from, Buffer matrix, bool opaque) {
+    if (matrix->length < 6 * 4)
+        return;
+    int32_t m[6];
+    memcpy(m, matrix->data, sizeof(m));
+
+    int64_t det = (int64_t)m[0] * m[4] - (int64_t)m[1] * m[3];
+    if (det == 0)
+        return;
+
+    // inverse matrix, mapping destination back to source, in 16.16
+    // multiply rather than shift, as the entries can be negative
+    const int64_t one = (int64_t)1 << 32;
+    int64_t inv[4] = {m[4] * one / det, -m[1] * one / det, -m[3] * one / det, m[0] * one / det};
+    for (int i = 0; i < 4; ++i)
+        if (inv[i] > INT32_MAX || inv[i] < INT32_MIN)
+            return; // shrunk to nothing
+    int32_t ia = inv[0], ib = inv[1], id = inv[2], ie = inv[3];
+    int64_t ic = -((int64_t)ia * m[2] + (int64_t)ib * m[5]) >> 16;
+    int64_t iff = -((int64_t)id * m[2] + (int64_t)ie * m[5]) >> 16;
+
+    auto w = from->width();
+    auto h = from->height();
+    auto sw = img->width();
+    auto sh = img->height();
+
+    // bounding box of the transformed source corners, clipped to the destination
+    int64_t minX = INT64_MAX, maxX = INT64_MIN, minY = INT64_MAX, maxY = INT64_MIN;
+    for (int i = 0; i < 4; ++i) {
+        int64_t cx = (i & 1) ? w : 0;
+        int64_t cy = (i & 2) ? h : 0;
+        int64_t tx = m[0] * cx + m[1] * cy + m[2];
+        int64_t ty = m[3] * cx + m[4] * cy + m[5];
+        minX = min(minX, tx);
+        maxX = max(maxX, tx);
+        minY = min(minY, ty);
+        maxY = max(maxY, ty);
+    }
+    int x0 = (int)max((int64_t)0, minX >> 16);
+    int x1 = (int)min((int64_t)sw, (maxX + 0xffff) >> 16);
+    int y0 = (int)max((int64_t)0, minY >> 16);
+    int y1 = (int)min((int64_t)sh, (maxY + 0xffff) >> 16);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    img->makeWritable(x0, y0, x1 - x0, y1 - y0);
+
+    bool fast = img->bpp() == 4 && from->bpp() == 4;
+    auto tbase = img->pix();
+    auto tbh = img->byteHeight();
+    auto fbase = from->pix();
+    auto fbh = from->byteHeight();
+
+    for (int x = x0; x < x1; ++x) {
+        // sample at pixel centers
+        int64_t px = ((int64_t)x << 16) + 0x8000;
+        int64_t py = ((int64_t)y0 << 16) + 0x8000;
+        int32_t sx = (int32_t)(((ia * px + ib * py) >> 16) + ic);
+        int32_t sy = (int32_t)(((id * px + ie * py) >> 16) + iff);
+        auto tcol = tbase + tbh * x;
+        for (int y = y0; y < y1; ++y, sx += ib, sy += ie) {
+            unsigned fx = sx >> 16;
+            unsigned fy = sy >> 16;
+            if (fx >= (unsigned)w || fy >= (unsigned)h)
+                continue;
+            if (fast) {
+                auto c = (fbase[fbh * fx + (fy >> 1)] >> ((fy & 1) << 2)) & 0xf;
+                if (!c && !opaque)
+                    continue;
+                auto p = tcol + (y >> 1);
+                if (y & 1)
+                    *p = (*p & 0x0f) | (c << 4);
+                else
+                    *p = (*p & 0xf0) | c;
+            } else {
+                auto c = getCore(from, fx, fy);
+                if (c || opaque)
+                    setCore(img, x, y, c);
+            }
+        }
+    }
+}
+
 void fillCircle(Image_ img, int cx, int cy, int r, int c) {
+    if (r <= 0)
+        return;
+    img->makeWritable(cx - r, cy - r, 2 * r + 1, 2 * r + 1);
+
+    // columns cx-d and cx+d, rows cy-h to cy+h
+#define SPANS(d, h)                                                                                \
+    fillSpan(img, cx + (d), cy - (h), cy + (h), c);                                                \
+    if (d)                                                                                         \
+    fillSpan(img, cx - (d), cy - (h), cy + (h), c)
+
+    // midpoint algorithm; each column is filled once, with the tallest span it gets
     int x = r - 1;
     int y = 0;
     int dx = 1;
     int dy = 1;
     int err = dx - (r << 1);
+    bool newY = true;
 
     while (x >= y) {
-        fillRect(img, cx + x, cy - y, 1, 1 + (y << 1), c);
-        fillRect(img, cx + y, cy - x, 1, 1 + (x << 1), c);
-        fillRect(img, cx - x, cy - y, 1, 1 + (y << 1), c);
-        fillRect(img, cx - y, cy - x, 1, 1 + (x << 1), c);
+        if (newY) {
+            SPANS(y, x);
+            newY = false;
+        }
         if (err <= 0) {
             ++y;
             err += dy;
             dy += 2;
+            newY = true;
+            if (x < y) {
+                SPANS(x, y - 1);
+            }
         } else {
+            SPANS(x, y);
             --x;
             dx += 2;
             err += dx - (r << 1);
         }
     }
+#undef SPANS
 }
 
+/**
+ * Fill a polygon given as Int16LE x, y pairs of its vertices. Vertices are at pixel corners, so
+ * that the polygon (x, y), (x+w, y), (x+w, y+h), (x, y+h) fills the same pixels as fillRect().
+ * Self-intersecting polygons are filled with the even-odd rule.
+ */
 //%
+void fillPolygon(Image_ img, Buffer points, int c) {
+    int n = points->length >> 2;
+    if (n < 3)
+        return;
+    auto pts = (int16_t *)points->data;
+
+    int minX = pts[0], maxX = pts[0], minY = pts[1], maxY = pts[1];
+    for (int i = 1; i < n; ++i) {
+        minX = min(minX, (int)pts[2 * i]);
+        maxX = max(maxX, (int)pts[2 * i]);
+        minY = min(minY, (int)pts[2 * i + 1]);
+        maxY = max(maxY, (int)pts[2 * i + 1]);
+    }
+    int x0 = max(minX, 0);
+    int x1 = min(maxX, img->width());
+    if (x0 >= x1 || maxY <= 0 || minY >= img->height())
+        return;
+
+    img->makeWritable(x0, minY, x1 - x0, maxY - minY);
+
+    // y of edges crossing the current column, in 16.16
+    int32_t buf[32];
+    int32_t *ys = n <= 32 ? buf : new int32_t[n];
+
+    for (int x = x0; x < x1; ++x) {
+        int num = 0;
+        for (int i = 0; i < n; ++i) {
+            int j = i + 1 == n ? 0 : i + 1;
+            int xa = pts[2 * i], ya = pts[2 * i + 1];
+            int xb = pts[2 * j], yb = pts[2 * j + 1];
+            if (xa > xb) {
+                swap(xa, xb);
+                swap(ya, yb);
+            }
+            // half-open, so that vertices are only counted once
+            if (x < xa || x >= xb)
+                continue;
+            auto y = (int64_t)ya * 0x10000 + (int64_t)(x - xa) * (yb - ya) * 0x10000 / (xb - xa);
+            // insertion sort; there are very few crossings
+            int k = num++;
+            while (k > 0 && ys[k - 1] > y) {
+                ys[k] = ys[k - 1];
+                k--;
+            }
+            ys[k] = (int32_t)y;
+        }
+        for (int k = 0; k + 1 < num; k += 2) {
+            // fill pixels with top edge in [ys[k], ys[k + 1])
+            int top = (ys[k] + 0xffff) >> 16;
+            int bot = ((ys[k + 1] + 0xffff) >> 16) - 1;
+            fillSpan(img, x, top, bot, c);
+        }
+    }
+
+    if (ys != buf)
+        delete[] ys;
+}
+
 void _fillCircle(Image_ img, int cxy, int r, int c) {
     fillCircle(img, XX(cxy), YY(cxy), r, c);
 }
@@ -8,6 +8,21 @@ namespace image {
         return concatY(arr)
     }
 
+    /**
+     * Create a matrix for drawImageTransformed(): scale by (scaleX, scaleY),
+     * rotate clockwise by angle degrees around the origin, then move by (x, y)
+     */
+    export function transformMatrix(angle: number, scaleX: number, scaleY: number, x: number, y: number): Buffer {
+        const r = angle * Math.PI / 180
+        const cos = Math.cos(r)
+        const sin = Math.sin(r)
+        const m = [cos * scaleX, -sin * scaleY, x, sin * scaleX, cos * scaleY, y]
+        const buf = control.createBuffer(24)
+        for (let i = 0; i < 6; ++i)
+            buf.setNumber(NumberFormat.Int32LE, i * 4, Math.round(m[i] * 65536))
+        return buf
+    }
+
     export function concatY(images: Image[]) {
         let w = 0
         let h = 0
@@ -67,6 +82,12 @@ interface Image {
     //% helper=imageFillCircle
     fillCircle(cx: number, cy: number, r: number, c: color): void;
 
+    /**
+     * Fills a triangle; vertices are at pixel corners
+     */
+    //% helper=imageFillTriangle
+    fillTriangle(x0: number, y0: number, x1: number, y1: number, x2: number, y2: number, c: color): void;
+
     /**
      * Returns an image rotated by -90, 0, 90, 180, 270 deg clockwise
      */
@@ -118,6 +139,9 @@ namespace helpers {
     //% shim=ImageMethods::_blitRow
     declare function _blitRow(img: Image, xy: number, from: Image, xh: number): void;
 
+    //% shim=ImageMethods::_drawTileMap
+    declare function _drawTileMap(img: Image, tiles: Buffer, tileset: Image[], params: number): void;
+
     function pack(x: number, y: number) {
         return (Math.clamp(-30000, 30000, x | 0) & 0xffff) | (Math.clamp(-30000, 30000, y | 0) << 16)
     }
@@ -126,6 +150,20 @@ namespace helpers {
         _blitRow(img, pack(dstX, dstY), from, pack(fromX, fromH))
     }
 
+    /**
+     * Draw the visible part of a tile map with the camera at (cameraX, cameraY).
+     * Returns false (and draws nothing) when the camera is too far away for the native renderer.
+     */
+    export function imageDrawTileMap(img: Image, tiles: Buffer, tileset: Image[], scale: number,
+        cameraX: number, cameraY: number): boolean {
+        cameraX |= 0
+        cameraY |= 0
+        if (cameraX < -8192 || cameraX >= 8192 || cameraY < -8192 || cameraY >= 8192)
+            return false
+        _drawTileMap(img, tiles, tileset, (scale & 7) | ((cameraX & 0x3fff) << 3) | (cameraY << 17))
+        return true
+    }
+
     export function imageDrawIcon(img: Image, icon: Buffer, x: number, y: number, c: color): void {
         _drawIcon(img, icon, pack(x, y), c)
     }
@@ -184,6 +222,21 @@ namespace helpers {
         _fillCircle(img, pack(cx, cy), r, col);
     }
 
+    let trianglePoints: Buffer
+
+    export function imageFillTriangle(img: Image, x0: number, y0: number, x1: number, y1: number, x2: number, y2: number, col: number) {
+        if (!trianglePoints)
+            trianglePoints = control.createBuffer(12)
+        const p = trianglePoints
+        p.setNumber(NumberFormat.Int16LE, 0, Math.clamp(-30000, 30000, x0 | 0))
+        p.setNumber(NumberFormat.Int16LE, 2, Math.clamp(-30000, 30000, y0 | 0))
+        p.setNumber(NumberFormat.Int16LE, 4, Math.clamp(-30000, 30000, x1 | 0))
+        p.setNumber(NumberFormat.Int16LE, 6, Math.clamp(-30000, 30000, y1 | 0))
+        p.setNumber(NumberFormat.Int16LE, 8, Math.clamp(-30000, 30000, x2 | 0))
+        p.setNumber(NumberFormat.Int16LE, 10, Math.clamp(-30000, 30000, y2 | 0))
+        img.fillPolygon(p, col)
+    }
+
     /**
      * Returns an image rotated by 90, 180, 270 deg clockwise
      */
@@ -123,11 +123,42 @@ declare interface Image {
     //% shim=ImageMethods::drawTransparentImage
     drawTransparentImage(from: Image, x: int32, y: int32): void;
 
+    /**
+     * Draw a list of images on the current image in one call. Every 8 byte record in `list` holds
+     * int16 index into `images`, int16 x, int16 y, and uint16 flags (bit 0 - opaque, like drawImage;
+     * otherwise the image is drawn with transparent background).
+     */
+    //% shim=ImageMethods::drawImageList
+    drawImageList(images: Image[], list: Buffer): void;
+
     /**
      * Check if the current image "collides" with another
      */
     //% shim=ImageMethods::overlapsWith
     overlapsWith(other: Image, x: int32, y: int32): boolean;
+
+    /**
+     * Check the current image against a list of images, at positions given in `positions` as
+     * pairs of int16 x and y. Returns a buffer with 1 for each image that overlaps and 0 otherwise.
+     */
+    //% shim=ImageMethods::overlapsWithList
+    overlapsWithList(others: Image[], positions: Buffer): Buffer;
+
+    /**
+     * Draw an image transformed by a 2x3 matrix, given as six Int32LE numbers in 16.16 fixed point
+     * (a, b, c, d, e, f). Source pixel (x, y) lands at (a*x + b*y + c, d*x + e*y + f).
+     * Unless `opaque`, color 0 is transparent.
+     */
+    //% shim=ImageMethods::drawImageTransformed
+    drawImageTransformed(from: Image, matrix: Buffer, opaque: boolean): void;
+
+    /**
+     * Fill a polygon given as Int16LE x, y pairs of its vertices. Vertices are at pixel corners, so
+     * that the polygon (x, y), (x+w, y), (x+w, y+h), (x, y+h) fills the same pixels as fillRect().
+     * Self-intersecting polygons are filled with the even-odd rule.
+     */
+    //% shim=ImageMethods::fillPolygon
+    fillPolygon(points: Buffer, c: int32): void;
 }
 declare namespace image {
 
@@ -384,10 +384,82 @@ namespace pxsim.ImageMethods {
         drawImageCore(img, from, x, y, false, false)
     }
 
+    export function drawImageList(img: RefImage, images: RefCollection, list: RefBuffer) {
+        const data = list.data
+        const numImages = images.getLength()
+        for (let off = 0; off + 8 <= data.length; off += 8) {
+            const idx = (data[off] | (data[off + 1] << 8)) << 16 >> 16
+            const x = (data[off + 2] | (data[off + 3] << 8)) << 16 >> 16
+            const y = (data[off + 4] | (data[off + 5] << 8)) << 16 >> 16
+            const flags = data[off + 6] | (data[off + 7] << 8)
+            const from = 0 <= idx && idx < numImages ? images.getAt(idx) : null
+            if (from instanceof RefImage)
+                drawImageCore(img, from, x, y, !!(flags & 1), false)
+        }
+    }
+
+    export function drawImageTransformed(img: RefImage, from: RefImage, matrix: RefBuffer, opaque: boolean) {
+        if (matrix.data.length < 24)
+            return
+        const view = new DataView(matrix.data.buffer, matrix.data.byteOffset, 24)
+        const m: number[] = []
+        for (let i = 0; i < 6; ++i)
+            m.push(view.getInt32(i * 4, true) / 65536)
+        const det = m[0] * m[4] - m[1] * m[3]
+        if (!det)
+            return
+        const ia = m[4] / det, ib = -m[1] / det, id = -m[3] / det, ie = m[0] / det
+        const ic = -(ia * m[2] + ib * m[5]), iff = -(id * m[2] + ie * m[5])
+
+        const w = from._width, h = from._height
+        let minX = Infinity, maxX = -Infinity, minY = Infinity, maxY = -Infinity
+        for (let i = 0; i < 4; ++i) {
+            const cx = (i & 1) ? w : 0
+            const cy = (i & 2) ? h : 0
+            const tx = m[0] * cx + m[1] * cy + m[2]
+            const ty = m[3] * cx + m[4] * cy + m[5]
+            minX = Math.min(minX, tx)
+            maxX = Math.max(maxX, tx)
+            minY = Math.min(minY, ty)
+            maxY = Math.max(maxY, ty)
+        }
+        const x0 = Math.max(0, Math.floor(minX)), x1 = Math.min(img._width, Math.ceil(maxX))
+        const y0 = Math.max(0, Math.floor(minY)), y1 = Math.min(img._height, Math.ceil(maxY))
+        if (x0 >= x1 || y0 >= y1)
+            return
+
+        img.makeWritable()
+        for (let x = x0; x < x1; ++x) {
+            for (let y = y0; y < y1; ++y) {
+                const fx = Math.floor(ia * (x + 0.5) + ib * (y + 0.5) + ic)
+                const fy = Math.floor(id * (x + 0.5) + ie * (y + 0.5) + iff)
+                if (fx < 0 || fx >= w || fy < 0 || fy >= h)
+                    continue
+                const c = from.data[from.pix(fx, fy)]
+                if (c || opaque)
+                    img.data[img.pix(x, y)] = c
+            }
+        }
+    }
+
     export function overlapsWith(img: RefImage, other: RefImage, x: number, y: number) {
         return drawImageCore(img, other, x, y, false, true)
     }
 
+    export function overlapsWithList(img: RefImage, others: RefCollection, positions: RefBuffer) {
+        const data = positions.data
+        const num = Math.min(others.getLength(), data.length >> 2)
+        const res = BufferMethods.createBuffer(num)
+        for (let i = 0; i < num; ++i) {
+            const other = others.getAt(i)
+            const x = (data[i * 4] | (data[i * 4 + 1] << 8)) << 16 >> 16
+            const y = (data[i * 4 + 2] | (data[i * 4 + 3] << 8)) << 16 >> 16
+            if (other instanceof RefImage && drawImageCore(img, other, x, y, false, true))
+                res.data[i] = 1
+        }
+        return res
+    }
+
     function drawLineLow(img: RefImage, x0: number, y0: number, x1: number, y1: number, c: number) {
         let dx = x1 - x0;
         let dy = y1 - y0;
@@ -580,6 +652,68 @@ namespace pxsim.ImageMethods {
         }
     }
 
+    export function _printRun(img: RefImage, text: string, font: RefBuffer, params: RefBuffer) {
+        const pp = params.data
+        if (pp.length < 8)
+            return
+        let x = (pp[0] | (pp[1] << 8)) << 16 >> 16
+        let y = (pp[2] | (pp[3] << 8)) << 16 >> 16
+        const color = pp[4]
+        const mult = Math.max(pp[5], 1)
+        const dataW = pp[6]
+        const dataH = pp[7]
+        const byteHeight = (dataH + 7) >> 3
+        const dataSize = 2 + byteHeight * dataW
+        const fontdata = font.data
+        if (!dataW || fontdata.length < dataSize)
+            return
+        const lastchar = Math.floor(fontdata.length / dataSize) - 1
+        const code = (idx: number) => fontdata[idx * dataSize] | (fontdata[idx * dataSize + 1] << 8)
+        const x0 = x
+
+        img.makeWritable()
+        for (let cp = 0; cp < text.length; ++cp) {
+            const ch = text.charCodeAt(cp)
+            if (ch == 10) {
+                y += dataH * mult + 2
+                x = x0
+            }
+            if (ch < 32)
+                continue
+
+            let off = 0
+            const guess = ch - 32
+            if (guess <= lastchar && code(guess) == ch)
+                off = guess * dataSize
+            else {
+                let l = 0
+                let r = lastchar
+                while (l <= r) {
+                    const m = l + ((r - l) >> 1)
+                    const v = code(m)
+                    if (v == ch) {
+                        off = m * dataSize
+                        break
+                    }
+                    if (v < ch)
+                        l = m + 1
+                    else
+                        r = m - 1
+                }
+            }
+
+            off += 2
+            for (let i = 0; i < dataW; ++i) {
+                for (let j = 0; j < dataH; ++j) {
+                    if (fontdata[off + (j >> 3)] & (1 << (j & 7)))
+                        fillRect(img, x + i * mult, y + j * mult, mult, mult, color)
+                }
+                off += byteHeight
+            }
+            x += dataW * mult
+        }
+    }
+
     export function _drawIcon(img: RefImage, icon: RefBuffer, xy: number, color: number) {
         drawIcon(img, icon, XX(xy), YY(xy), color)
     }
@@ -608,6 +742,43 @@ namespace pxsim.ImageMethods {
         }
     }
 
+    export function fillPolygon(img: RefImage, points: RefBuffer, c: number) {
+        const data = points.data
+        const n = data.length >> 2
+        if (n < 3)
+            return
+        const view = new DataView(data.buffer, data.byteOffset, n * 4)
+        const px: number[] = []
+        const py: number[] = []
+        for (let i = 0; i < n; ++i) {
+            px.push(view.getInt16(i * 4, true))
+            py.push(view.getInt16(i * 4 + 2, true))
+        }
+        const x0 = Math.max(Math.min(...px), 0)
+        const x1 = Math.min(Math.max(...px), img._width)
+        for (let x = x0; x < x1; ++x) {
+            const ys: number[] = []
+            for (let i = 0; i < n; ++i) {
+                const j = i + 1 == n ? 0 : i + 1
+                let xa = px[i], ya = py[i], xb = px[j], yb = py[j]
+                if (xa > xb) {
+                    [xa, xb] = [xb, xa];
+                    [ya, yb] = [yb, ya]
+                }
+                if (x < xa || x >= xb)
+                    continue
+                ys.push(ya + (x - xa) * (yb - ya) / (xb - xa))
+            }
+            ys.sort((a, b) => a - b)
+            for (let k = 0; k + 1 < ys.length; k += 2) {
+                const top = Math.ceil(ys[k])
+                const bot = Math.ceil(ys[k + 1])
+                if (bot > top)
+                    fillRect(img, x, top, 1, bot - top, c)
+            }
+        }
+    }
+
     export function _fillCircle(img: RefImage, cxy: number, r: number, c: number) {
         fillCircle(img, XX(cxy), YY(cxy), r, c);
     }
@@ -616,6 +787,52 @@ namespace pxsim.ImageMethods {
         blitRow(img, XX(xy), YY(xy), from, XX(xh), YY(xh))
     }
 
+    export function _drawTileMap(img: RefImage, tiles: RefBuffer, tileset: RefCollection, params: number) {
+        const data = tiles.data
+        if (data.length < 4)
+            return
+        const scale = params & 7
+        const camX = (params << 15) >> 18
+        const camY = params >> 17
+        const size = 1 << scale
+        const mask = size - 1
+        const mapW = data[0] | (data[1] << 8)
+        const mapH = data[2] | (data[3] << 8)
+        if (data.length < 4 + mapW * mapH)
+            return
+
+        const offX = camX & mask
+        const offY = camY & mask
+        const x0 = Math.max(0, camX >> scale)
+        const xn = Math.min(mapW, ((camX + img._width) >> scale) + 1)
+        const y0 = Math.max(0, camY >> scale)
+        const yn = Math.min(mapH, ((camY + img._height) >> scale) + 1)
+        const numTiles = Math.min(tileset.getLength(), 256)
+
+        img.makeWritable()
+        for (let x = x0; x <= xn; ++x) {
+            for (let y = y0; y <= yn; ++y) {
+                const idx = x < mapW && y < mapH ? data[4 + x + y * mapW] : 0
+                const tile = idx < numTiles ? tileset.getAt(idx) : null
+                if (!(tile instanceof RefImage))
+                    continue
+                const px = ((x - x0) << scale) - offX
+                const py = ((y - y0) << scale) - offY
+                const tw = Math.min(tile._width, size)
+                const th = Math.min(tile._height, size)
+                for (let ty = 0; ty < th; ++ty) {
+                    if (!img.inRange(0, py + ty))
+                        continue
+                    for (let tx = 0; tx < tw; ++tx) {
+                        const c = tile.data[tile.pix(tx, ty)]
+                        if (c && img.inRange(px + tx, py + ty))
+                            img.data[img.pix(px + tx, py + ty)] = c
+                    }
+                }
+            }
+        }
+    }
+
     export function blitRow(img: RefImage, x: number, y: number, from: RefImage, fromX: number, fromH: number) {
         x |= 0
         y |= 0
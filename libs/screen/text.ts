@@ -204,6 +204,12 @@ interface Image {
 }
 
 namespace helpers {
+    //% shim=ImageMethods::_printRun
+    declare function _printRun(img: Image, text: string, font: Buffer, params: Buffer): void;
+
+    // reused for every _printRun() call
+    let printParams: Buffer
+
     export function imagePrintCenter(img: Image, text: string, y: number, color?: number, font?: image.Font) {
         if (!font) font = image.getFontForText(text)
         let w = text.length * font.charWidth
@@ -226,6 +232,22 @@ namespace helpers {
         let charSize = byteHeight * dataW
         let dataSize = 2 + charSize
         let fontdata = font.data
+
+        if (!offsets && dataW * mult == font.charWidth && dataH * mult == font.charHeight &&
+            dataW < 256 && dataH < 256 && mult < 256 &&
+            -30000 < x && x < 30000 && -30000 < y && y < 30000) {
+            if (!printParams)
+                printParams = control.createBuffer(8)
+            printParams.setNumber(NumberFormat.Int16LE, 0, x)
+            printParams.setNumber(NumberFormat.Int16LE, 2, y)
+            printParams[4] = color
+            printParams[5] = mult
+            printParams[6] = dataW
+            printParams[7] = dataH
+            _printRun(img, text, fontdata, printParams)
+            return
+        }
+
         let lastchar = Math.idiv(fontdata.length, dataSize) - 1
         let imgBuf: Buffer
         if (mult == 1) {